@@ -22,28 +22,152 @@ file named "LICENSE.txt".
 
 #include "LEM1802Window.hpp"
 
-void LEM1802Window::update()
+namespace {
+    // rasterises a LEM1802 screen from its raw words: the video, font and
+    // palette textures hold one word per texel, high byte in red and low byte
+    // in green
+    const char* const lem_fragment_shader =
+        "uniform sampler2D video;\n"
+        "uniform sampler2D font;\n"
+        "uniform sampler2D palette;\n"
+        "uniform float connected;\n"
+        "uniform float blink;\n"
+        "\n"
+        "float word(vec4 texel)\n"
+        "{\n"
+        "    return floor(texel.r * 255.0 + 0.5) * 256.0 + floor(texel.g * 255.0 + 0.5);\n"
+        "}\n"
+        "\n"
+        "void main()\n"
+        "{\n"
+        "    if (connected < 0.5) {\n"
+        "        gl_FragColor = vec4(0.0, 0.0, 0.0, 1.0);\n"
+        "        return;\n"
+        "    }\n"
+        "\n"
+        "    vec2 pixel = floor(gl_TexCoord[0].xy * vec2(128.0, 96.0));\n"
+        "    vec2 cell = floor(pixel / vec2(4.0, 8.0));\n"
+        "    vec2 inner = pixel - cell * vec2(4.0, 8.0);\n"
+        "\n"
+        "    float cell_word = word(texture2D(video, (cell + 0.5) / vec2(32.0, 12.0)));\n"
+        "    float character = mod(cell_word, 128.0);\n"
+        "    float blinking = mod(floor(cell_word / 128.0), 2.0);\n"
+        "    float background = mod(floor(cell_word / 256.0), 16.0);\n"
+        "    float foreground = floor(cell_word / 4096.0);\n"
+        "\n"
+        "    // each glyph is two words, each word two columns of eight bits, top pixel lowest\n"
+        "    float glyph_word = word(texture2D(font, vec2((character * 2.0 + floor(inner.x / 2.0) + 0.5) / 256.0, 0.5)));\n"
+        "    float column = mod(inner.x, 2.0) < 0.5 ? floor(glyph_word / 256.0) : mod(glyph_word, 256.0);\n"
+        "    float lit = mod(floor(column / pow(2.0, inner.y)), 2.0);\n"
+        "    if (blinking > 0.5 && blink > 0.5)\n"
+        "        lit = 0.0;\n"
+        "\n"
+        "    float colour = lit > 0.5 ? foreground : background;\n"
+        "    float entry = word(texture2D(palette, vec2((colour + 0.5) / 16.0, 0.5)));\n"
+        "    gl_FragColor = vec4(floor(entry / 256.0), mod(floor(entry / 16.0), 16.0), mod(entry, 16.0), 15.0) / 15.0;\n"
+        "}\n";
+
+    template <std::size_t N, std::size_t M>
+    void words_to_texels(const std::array<std::uint16_t, N>& words, std::array<sf::Uint8, M>& texels)
+    {
+        for (std::size_t i = 0; i < N; i++) {
+            texels[i * 4] = words[i] >> 8;
+            texels[i * 4 + 1] = words[i] & 0xff;
+            texels[i * 4 + 2] = 0;
+            texels[i * 4 + 3] = 255;
+        }
+    }
+}
+
+bool LEM1802Window::setup_shader()
 {
-    std::array<std::array<galaxy::saturn::color, galaxy::saturn::lem1802::width>, galaxy::saturn::lem1802::height> image = lem.image();
+    // SFML has already said why on sf::err() if it didn't compile
+    if (!shader.loadFromMemory(lem_fragment_shader, sf::Shader::Fragment))
+        return false;
 
-    sf::Uint8* pixels = new sf::Uint8[galaxy::saturn::lem1802::width * galaxy::saturn::lem1802::height * 4];
+    video_texture.create(32, 12);
+    font_texture.create(lem_frame::font_words, 1);
+    palette_texture.create(lem_frame::palette_words, 1);
 
-    for (int y = 0; y < image.size(); y++) {
-        for (int x = 0; x < image[y].size(); x++) {
-            pixels[(y * 128 + x) * 4] = image[y][x].r;
-            pixels[(y * 128 + x) * 4 + 1] = image[y][x].g;
-            pixels[(y * 128 + x) * 4 + 2] = image[y][x].b;
-            pixels[(y * 128 + x) * 4 + 3] = 255;
-        }
+    shader.setUniform("video", video_texture);
+    shader.setUniform("font", font_texture);
+    shader.setUniform("palette", palette_texture);
+    return true;
+}
+
+bool LEM1802Window::update()
+{
+    // pick up the newest frame the emulation thread published, if any
+    if (frames.update()) {
+        if (use_shader)
+            upload_raw(frames.read_buffer());
+        else
+            upload_pixels(frames.read_buffer());
+
+        shown_sequence = frames.read_buffer().sequence;
+        needs_redraw = true;
     }
 
-    screen_texture.update(pixels);
+    // blinking is up to the shader, so the window has to keep time for it
+    if (use_shader && blink_clock.getElapsedTime().asMilliseconds() >= blink_interval) {
+        blink_clock.restart();
+        blink_phase = !blink_phase;
+        needs_redraw = true;
+    }
 
-    galaxy::saturn::color border = lem.border();
+    if (!needs_redraw)
+        return false;
+
+    const galaxy::saturn::color& border = frames.read_buffer().border;
 
     clear(sf::Color(border.r, border.g, border.b, 255));
-    draw(screen);
-    display();
+    if (use_shader) {
+        shader.setUniform("connected", frames.read_buffer().connected ? 1.f : 0.f);
+        shader.setUniform("blink", blink_phase ? 1.f : 0.f);
+        draw(screen, &shader);
+    } else {
+        draw(screen);
+    }
+
+    needs_redraw = false;
+    return true;
+}
+
+void LEM1802Window::upload_pixels(const lem_frame& frame)
+{
+    const sf::Uint8* pixels = reinterpret_cast<const sf::Uint8*>(frame.pixels.data());
+
+    if (frame.sequence != shown_sequence + 1) {
+        // we missed a frame in between, so we don't know what changed
+        screen_texture.update(pixels);
+        return;
+    }
+
+    // upload each run of changed cell rows; they span the full width, so
+    // they are contiguous in the frame and need no copying
+    for (unsigned int row = 0; row < lem_frame::cell_rows; ) {
+        if (!(frame.dirty_rows & (1 << row))) {
+            row++;
+            continue;
+        }
+
+        unsigned int end = row;
+        while (end < lem_frame::cell_rows && (frame.dirty_rows & (1 << end)))
+            end++;
+
+        unsigned int y = row * lem_frame::cell_height;
+        screen_texture.update(pixels + y * lem_frame::width * 4, lem_frame::width, (end - row) * lem_frame::cell_height, 0, y);
+        row = end;
+    }
+}
+
+void LEM1802Window::upload_raw(const lem_frame& frame)
+{
+    words_to_texels(frame.video, video_texels);
+    words_to_texels(frame.font, font_texels);
+    words_to_texels(frame.palette, palette_texels);
 
-    delete[] pixels;
+    video_texture.update(video_texels.data());
+    font_texture.update(font_texels.data());
+    palette_texture.update(palette_texels.data());
 }
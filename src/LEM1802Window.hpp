@@ -22,11 +22,19 @@ file named "LICENSE.txt".
 
 #include <libsaturn.hpp>
 
+#include "lem_frame.hpp"
+#include "triple_buffer.hpp"
+
 #include <SFML/Graphics.hpp>
 
 class LEM1802Window : public sf::RenderWindow {
     public:
-        LEM1802Window(galaxy::saturn::lem1802& lem) : RenderWindow(sf::VideoMode((galaxy::saturn::lem1802::width + border * 2) * 4, (galaxy::saturn::lem1802::height + border * 2) * 4), "Saturn"), lem(lem)
+        /// with use_shader, the frames must carry raw words (see
+        /// lem_frame::capture_raw) and the screen is rasterised by a fragment
+        /// shader. if the shader doesn't compile the window goes without;
+        /// uses_shader() says which, before the frames start coming
+        LEM1802Window(triple_buffer<lem_frame>& frames, bool use_shader) : RenderWindow(sf::VideoMode((galaxy::saturn::lem1802::width + border * 2) * 4, (galaxy::saturn::lem1802::height + border * 2) * 4), "Saturn"),
+            frames(frames), shown_sequence(0), needs_redraw(true), use_shader(use_shader), blink_phase(false)
         {
             screen_image.create(galaxy::saturn::lem1802::width, galaxy::saturn::lem1802::height, sf::Color(0, 0, 255));
             screen_texture.loadFromImage(screen_image);
@@ -34,14 +42,50 @@ class LEM1802Window : public sf::RenderWindow {
             screen.setScale(sf::Vector2f(4.f, 4.f));
             screen.setPosition(sf::Vector2f(border * 4, border * 4));
 
+            if (use_shader && !setup_shader())
+                this->use_shader = false;
+
             setVerticalSyncEnabled(true);
         }
-        void update();
+        /// draws the newest frame if there is anything new to show; returns
+        /// whether the window was redrawn, in which case it still needs a
+        /// display() to show it
+        bool update();
+
+        /// makes the next update() redraw even if no new frame arrived
+        void invalidate() { needs_redraw = true; }
+
+        /// whether the frames have to carry raw words; draw_on_cpu() makes
+        /// it take pixels after all, for when another window couldn't
+        /// compile its shader
+        bool uses_shader() const { return use_shader; }
+        void draw_on_cpu() { use_shader = false; }
     private:
-        galaxy::saturn::lem1802& lem;
+        /// false if the shader didn't compile
+        bool setup_shader();
+        void upload_pixels(const lem_frame& frame);
+        void upload_raw(const lem_frame& frame);
+
+        triple_buffer<lem_frame>& frames;
+        std::uint64_t shown_sequence;
+        bool needs_redraw;
         sf::Image screen_image;
         sf::Texture screen_texture;
         sf::Sprite screen;
 
+        // the shader path keeps the LEM's words in small textures, two bytes
+        // of each texel holding one word
+        bool use_shader;
+        sf::Shader shader;
+        sf::Texture video_texture;
+        sf::Texture font_texture;
+        sf::Texture palette_texture;
+        std::array<sf::Uint8, lem_frame::video_words * 4> video_texels;
+        std::array<sf::Uint8, lem_frame::font_words * 4> font_texels;
+        std::array<sf::Uint8, lem_frame::palette_words * 4> palette_texels;
+        sf::Clock blink_clock;
+        bool blink_phase;
+
         static const unsigned int border = 3;
+        static const sf::Int32 blink_interval = 500;
 };
@@ -22,6 +22,51 @@ file named "LICENSE.txt".
 
 #include "SPED3Window.hpp"
 
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER 0x8892
+#endif
+#ifndef GL_STATIC_DRAW
+#define GL_STATIC_DRAW 0x88E4
+#endif
+
+namespace {
+    // x, y, z, then r, g, b
+    const std::size_t floats_per_vertex = 6;
+
+    const GLfloat degrees_per_second = 50;
+}
+
+SPED3Window::~SPED3Window()
+{
+    if (vertex_buffer) {
+        setActive(true);
+        delete_buffers(1, &vertex_buffer);
+    }
+}
+
+void SPED3Window::setup_buffer()
+{
+    vertices.resize(sped_frame::max_vertices * floats_per_vertex);
+
+    // without vertex buffers it's immediate mode, which for a couple of
+    // hundred vertices hardly matters
+    int major = 0, minor = 0;
+    const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+    if (!version || std::sscanf(version, "%d.%d", &major, &minor) != 2 || major < 1 || (major == 1 && minor < 5))
+        return;
+
+    gen_buffers = reinterpret_cast<gen_buffers_function>(sf::Context::getFunction("glGenBuffers"));
+    delete_buffers = reinterpret_cast<delete_buffers_function>(sf::Context::getFunction("glDeleteBuffers"));
+    bind_buffer = reinterpret_cast<bind_buffer_function>(sf::Context::getFunction("glBindBuffer"));
+    buffer_data = reinterpret_cast<buffer_data_function>(sf::Context::getFunction("glBufferData"));
+    if (gen_buffers && delete_buffers && bind_buffer && buffer_data)
+        gen_buffers(1, &vertex_buffer);
+}
+
 void SPED3Window::reshape(int w, int h)
 {
     setActive(true);
@@ -29,30 +74,104 @@ void SPED3Window::reshape(int w, int h)
     glViewport(0, 0, (GLsizei) w, (GLsizei) h);
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
-    glOrtho(-50.0, 50.0, -50.0, 50.0, -1.0, 1.0);
+
+    // leave room around the 256 unit cube whichever way it is turned
+    GLdouble aspect = h > 0 ? (GLdouble) w / h : 1.0;
+    glOrtho(-200.0 * aspect, 200.0 * aspect, -200.0, 200.0, -400.0, 400.0);
     glMatrixMode(GL_MODELVIEW);
     glLoadIdentity();
+
+    needs_redraw = true;
 }
 
-void SPED3Window::update()
+bool SPED3Window::update()
 {
     setActive(true);
 
+    if (frames.update()) {
+        upload(frames.read_buffer());
+        target_rotation = frames.read_buffer().rotation;
+        needs_redraw = true;
+    }
+
+    // turn towards the target rotation the short way round
+    GLfloat seconds = rotation_clock.restart().asSeconds();
+    if (rotation != target_rotation) {
+        GLfloat difference = std::fmod(target_rotation - rotation + 540.f, 360.f) - 180.f;
+        GLfloat step = degrees_per_second * seconds;
+        if (std::fabs(difference) <= step)
+            rotation = target_rotation;
+        else
+            rotation = std::fmod(rotation + (difference > 0 ? step : -step) + 360.f, 360.f);
+        needs_redraw = true;
+    }
+
+    if (!needs_redraw)
+        return false;
+
     glClear (GL_COLOR_BUFFER_BIT);
     glPushMatrix();
-    glRotatef(spin, 0.0, 0.0, 1.0);
-    glColor3f(1.0, 1.0, 1.0);
-    glRectf(-25.0, -25.0, 25.0, 25.0);
+
+    // look down on the projection at an angle, and turn it about its base's
+    // centre; device coordinates run from 0 to 255 with z pointing up
+    glRotatef(-60.0, 1.0, 0.0, 0.0);
+    glRotatef(rotation, 0.0, 0.0, 1.0);
+    glTranslatef(-128.0, -128.0, -64.0);
+
+    if (vertex_buffer) {
+        bind_buffer(GL_ARRAY_BUFFER, vertex_buffer);
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_COLOR_ARRAY);
+        glVertexPointer(3, GL_FLOAT, floats_per_vertex * sizeof(GLfloat), (const GLvoid*) 0);
+        glColorPointer(3, GL_FLOAT, floats_per_vertex * sizeof(GLfloat), (const GLvoid*) (3 * sizeof(GLfloat)));
+
+        glDrawArrays(GL_LINE_STRIP, 0, vertex_count);
+
+        glDisableClientState(GL_COLOR_ARRAY);
+        glDisableClientState(GL_VERTEX_ARRAY);
+        bind_buffer(GL_ARRAY_BUFFER, 0);
+    } else {
+        glBegin(GL_LINE_STRIP);
+        for (GLsizei i = 0; i < vertex_count; i++) {
+            const GLfloat* vertex = &vertices[i * floats_per_vertex];
+            glColor3fv(vertex + 3);
+            glVertex3fv(vertex);
+        }
+        glEnd();
+    }
+
     glPopMatrix();
 
     glFlush();
 
-    display();
+    needs_redraw = false;
+    return true;
 }
 
-void SPED3Window::spinS()
+void SPED3Window::upload(const sped_frame& frame)
 {
-    spin = spin + 2.0;
-    if (spin > 360)
-        spin -= 360.0;
+    for (unsigned int i = 0; i < frame.count; i++) {
+        std::uint16_t first = frame.words[i * 2];
+        std::uint16_t second = frame.words[i * 2 + 1];
+
+        GLfloat* vertex = &vertices[i * floats_per_vertex];
+        vertex[0] = first & 0xff;
+        vertex[1] = first >> 8;
+        vertex[2] = second & 0xff;
+
+        // colours are black, red, green and blue, dimmed without the intensity bit
+        GLfloat intensity = (second & 0x400) ? 1.0f : 0.6f;
+        unsigned int colour = (second >> 8) & 0x3;
+        vertex[3] = colour == 1 ? intensity : 0.0f;
+        vertex[4] = colour == 2 ? intensity : 0.0f;
+        vertex[5] = colour == 3 ? intensity : 0.0f;
+    }
+
+    vertex_count = frame.count;
+
+    if (vertex_buffer) {
+        bind_buffer(GL_ARRAY_BUFFER, vertex_buffer);
+        buffer_data(GL_ARRAY_BUFFER, vertex_count * floats_per_vertex * sizeof(GLfloat), &vertices[0], GL_STATIC_DRAW);
+        bind_buffer(GL_ARRAY_BUFFER, 0);
+    }
 }
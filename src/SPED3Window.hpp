@@ -22,26 +22,74 @@ file named "LICENSE.txt".
 
 #include <libsaturn.hpp>
 
+#include "sped_frame.hpp"
+#include "triple_buffer.hpp"
+
 #include <SFML/Window.hpp>
 #include <SFML/OpenGL.hpp>
 
+#include <cstddef>
+#include <vector>
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
 class SPED3Window : public sf::Window {
     public:
-        SPED3Window(galaxy::saturn::sped3& sped) : Window(sf::VideoMode(512, 512), "Saturn"), sped(sped), spin(0.0)
+        SPED3Window(triple_buffer<sped_frame>& frames) : Window(sf::VideoMode(512, 512), "Saturn"), frames(frames),
+            gen_buffers(0), delete_buffers(0), bind_buffer(0), buffer_data(0), vertex_buffer(0), vertex_count(0), rotation(0), target_rotation(0), needs_redraw(true)
         {
             setActive(true);
 
             glClearColor (0.0, 0.0, 0.0, 0.0);
             glShadeModel(GL_FLAT);
 
+            setup_buffer();
+
             reshape(512, 512);
 
             setVerticalSyncEnabled(true);
         }
+        ~SPED3Window();
         void reshape(int w, int h);
-        void update();
-        void spinS();
+
+        /// projects the newest vertices; returns whether the window was
+        /// redrawn, which only happens when the vertices changed or the device
+        /// is turning, in which case it still needs a display() to show it
+        bool update();
+
+        /// makes the next update() redraw even if nothing changed
+        void invalidate() { needs_redraw = true; }
     private:
-        galaxy::saturn::sped3& sped;
-        GLfloat spin;
+        /// makes a vertex buffer if the context has them, leaving
+        /// vertex_buffer zero (and drawing in immediate mode) if not
+        void setup_buffer();
+        void upload(const sped_frame& frame);
+
+        triple_buffer<sped_frame>& frames;
+
+        // vertex buffers are OpenGL 1.5, which the headers on some platforms
+        // (Windows, mostly) don't declare, so they're looked up through SFML
+        typedef void (APIENTRY* gen_buffers_function)(GLsizei n, GLuint* buffers);
+        typedef void (APIENTRY* delete_buffers_function)(GLsizei n, const GLuint* buffers);
+        typedef void (APIENTRY* bind_buffer_function)(GLenum target, GLuint buffer);
+        typedef void (APIENTRY* buffer_data_function)(GLenum target, std::ptrdiff_t size, const GLvoid* data, GLenum usage);
+        gen_buffers_function gen_buffers;
+        delete_buffers_function delete_buffers;
+        bind_buffer_function bind_buffer;
+        buffer_data_function buffer_data;
+
+        // the vertices live on the GPU, and are only uploaded when the program
+        // changes them; without a vertex buffer they're kept here instead
+        GLuint vertex_buffer;
+        std::vector<GLfloat> vertices;
+        GLsizei vertex_count;
+
+        // the device turns towards its target rotation at a fixed rate
+        GLfloat rotation;
+        GLfloat target_rotation;
+        sf::Clock rotation_clock;
+
+        bool needs_redraw;
 };
@@ -0,0 +1,277 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+/* libsaturn */
+#include <libsaturn.hpp>
+
+/* implementation specific */
+#include "machine.hpp"
+#include "loader.hpp"
+
+/* standard library */
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <new>
+#include <string>
+#include <vector>
+
+/* third party */
+#include "OptionParser.h"
+
+// every heap allocation made by the benchmark is counted, so that we notice
+// when something starts allocating on the hot path
+static std::atomic<std::uint64_t> allocations(0);
+
+void* operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+struct benchmark {
+    std::string name;
+    std::string filename;
+};
+
+struct result {
+    std::string name;
+    cpu_backend backend;
+    /// as the machine counts them: one per dcpu::cycle(), which runs a whole
+    /// instruction, so also the number of instructions run
+    std::uint64_t cycles;
+    double seconds;
+    std::uint64_t allocations;
+    bool crashed;
+};
+
+// the canned programs live in bench/, next to them we also run the examples
+// that don't need any user input or disks to keep going
+static std::vector<benchmark> benchmarks()
+{
+    const std::string bench_dir = SATURN_BENCH_DIR;
+    const std::string examples_dir = SATURN_EXAMPLES_DIR;
+
+    const char* canned[] = { "alu_loop", "mem_copy", "int_storm", "hwi_traffic" };
+    const char* examples[] = { "test", "key", "sped_pyramid" };
+
+    std::vector<benchmark> list;
+    for (std::size_t i = 0; i < sizeof(canned) / sizeof(canned[0]); i++) {
+        benchmark b = { canned[i], bench_dir + "/" + canned[i] + ".bin" };
+        list.push_back(b);
+    }
+    for (std::size_t i = 0; i < sizeof(examples) / sizeof(examples[0]); i++) {
+        benchmark b = { std::string("examples/") + examples[i], examples_dir + "/" + examples[i] + ".bin" };
+        list.push_back(b);
+    }
+    return list;
+}
+
+// runs a fresh machine for the given number of cycles; the machine has the
+// same devices as a default saturn run: one LEM1802, one SPED-3, clock and keyboard
+static bool run(const benchmark& b, cpu_backend backend, std::uint64_t cycles, result& r)
+{
+    machine m(1, 1, std::list<std::string>(), disk_backend::fstream, backend);
+    // several of the programs end in a loop, which is what we want to time
+    m.fast_forward = false;
+    if (!load_binary(m.cpu, b.filename))
+        return false;
+
+    r.name = b.name;
+    r.backend = backend;
+    r.cycles = 0;
+    r.crashed = false;
+
+    std::uint64_t allocations_before = allocations.load();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    while (r.cycles < cycles && !r.crashed) {
+        run_result stop = m.run(cycles - r.cycles);
+        r.cycles += stop.cycles;
+        r.crashed = is_final(stop.reason);
+    }
+
+    r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    r.allocations = allocations.load() - allocations_before;
+    return true;
+}
+
+// a run that stopped before its first instruction, or too quickly for the
+// clock to see, has no rate
+static bool timed(const result& r)
+{
+    return r.cycles > 0 && r.seconds > 0;
+}
+
+// whether a ran its instructions faster than b, without dividing by either
+static bool faster(const result& a, const result& b)
+{
+    return a.seconds * b.cycles < b.seconds * a.cycles;
+}
+
+static void print_table(const std::vector<result>& results)
+{
+    std::cout << std::left << std::setw(24) << "benchmark"
+              << std::setw(12) << "backend"
+              << std::right << std::setw(14) << "instructions"
+              << std::setw(12) << "MIPS"
+              << std::setw(12) << "ns/instr"
+              << std::setw(12) << "allocs" << std::endl;
+
+    for (auto it = results.begin(); it != results.end(); ++it) {
+        std::cout << std::left << std::setw(24) << it->name
+                  << std::setw(12) << cpu_backend_name(it->backend)
+                  << std::right << std::setw(14) << it->cycles;
+        if (timed(*it)) {
+            std::cout << std::setw(12) << std::fixed << std::setprecision(2) << it->cycles / it->seconds / 1e6
+                      << std::setw(12) << std::fixed << std::setprecision(2) << it->seconds * 1e9 / it->cycles;
+        } else {
+            std::cout << std::setw(12) << "-" << std::setw(12) << "-";
+        }
+        std::cout << std::setw(12) << it->allocations
+                  << (it->crashed ? "  (crashed)" : "") << std::endl;
+    }
+}
+
+static void print_json(const std::vector<result>& results)
+{
+    std::cout << "{\n  \"benchmarks\": [";
+    for (auto it = results.begin(); it != results.end(); ++it) {
+        std::cout << (it == results.begin() ? "\n" : ",\n")
+                  << "    {\"name\": \"" << it->name << "\""
+                  << ", \"backend\": \"" << cpu_backend_name(it->backend) << "\""
+                  << ", \"instructions\": " << it->cycles
+                  << ", \"seconds\": " << std::setprecision(9) << it->seconds;
+        // JSON has no inf or nan, so a run without a rate gets null
+        if (timed(*it)) {
+            std::cout << ", \"mips\": " << it->cycles / it->seconds / 1e6
+                      << ", \"ns_per_instruction\": " << it->seconds * 1e9 / it->cycles;
+        } else {
+            std::cout << ", \"mips\": null, \"ns_per_instruction\": null";
+        }
+        std::cout << ", \"allocations\": " << it->allocations
+                  << ", \"crashed\": " << (it->crashed ? "true" : "false") << "}";
+    }
+    std::cout << "\n  ]\n}" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    optparse::OptionParser parser = optparse::OptionParser()
+        .description("Saturn's emulator throughput benchmark")
+        .usage("usage: %prog [options] [benchmark...]");
+
+    parser.add_option("-c", "--cycles")
+        .dest("cycles")
+        .type("long")
+        .help("Number of cycles (one per instruction) to run each benchmark for (default: 10000000)");
+
+    parser.add_option("-r", "--repeat")
+        .dest("repeat")
+        .type("int")
+        .help("Run each benchmark this many times and keep the fastest (default: 3)");
+
+    parser.add_option("-b", "--backend")
+        .dest("backends")
+        .action("append")
+        .help("Run on this cpu backend; may be given more than once (default: every backend)");
+
+    parser.add_option("--json")
+        .dest("json")
+        .action("store_true")
+        .help("Print the results as JSON");
+
+    optparse::Values options = parser.parse_args(argc, argv);
+    std::vector<std::string> selected = parser.args();
+
+    std::uint64_t cycles = 10000000;
+    if (std::string(options.get("cycles")) != "") {
+        long given = (long)options.get("cycles");
+        if (given <= 0) {
+            std::cerr << "Error: each benchmark has to run for at least one cycle" << std::endl;
+            return -1;
+        }
+        cycles = given;
+    }
+
+    int repeat = 3;
+    if (std::string(options.get("repeat")) != "")
+        repeat = (int)options.get("repeat");
+    if (repeat < 1) {
+        std::cerr << "Error: each benchmark has to run at least once" << std::endl;
+        return -1;
+    }
+
+    // every benchmark runs on each backend in turn, so they can be compared side by side
+    std::vector<cpu_backend> backends;
+    std::list<std::string> backend_names = options.all("backends");
+    for (auto it = backend_names.begin(); it != backend_names.end(); ++it) {
+        cpu_backend backend;
+        if (!parse_cpu_backend(*it, backend)) {
+            std::cerr << "Error: invalid cpu backend \"" << *it << "\"" << std::endl;
+            return -1;
+        }
+        backends.push_back(backend);
+    }
+    if (backends.empty())
+        backends = cpu_backends();
+
+    std::vector<result> results;
+    std::vector<benchmark> list = benchmarks();
+    for (auto it = list.begin(); it != list.end(); ++it) {
+        // positional arguments pick out benchmarks by name
+        bool wanted = selected.empty();
+        for (auto name = selected.begin(); name != selected.end(); ++name)
+            wanted = wanted || *name == it->name;
+        if (!wanted)
+            continue;
+
+        for (auto backend = backends.begin(); backend != backends.end(); ++backend) {
+            result best;
+            for (int i = 0; i < repeat; i++) {
+                result r;
+                if (!run(*it, *backend, cycles, r))
+                    return -1;
+                if (i == 0 || faster(r, best))
+                    best = r;
+            }
+            results.push_back(best);
+        }
+    }
+
+    if (options.get("json"))
+        print_json(results);
+    else
+        print_table(results);
+
+    return 0;
+}
@@ -0,0 +1,57 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#ifndef CPU_CORE_HPP
+#define CPU_CORE_HPP
+
+#include <cstdint>
+
+/// an interpreter of saturn's own that runs a libsaturn dcpu in place of
+/// dcpu::cycle(), working directly on its public registers and memory. what a
+/// core can't do itself (anything touching state libsaturn keeps private) it
+/// hands to dcpu::cycle()
+class cpu_core {
+    public:
+        cpu_core() : stop_at_spins(false) {}
+        virtual ~cpu_core() {}
+
+        /// runs one whole instruction and ticks the devices once, just as
+        /// dcpu::cycle() does (skipping any that are asleep, if they're let
+        /// sleep)
+        virtual void step() = 0;
+
+        /// steps until done reaches budget or the instruction at PC is one
+        /// for dcpu::cycle(), or one the stop points might stop at; done is
+        /// kept up to date if that throws
+        virtual void run(std::uint64_t budget, std::uint64_t& done) = 0;
+
+        /// drops what was decoded at address, or everywhere, for when the
+        /// stop points change
+        virtual void forget(std::uint16_t address) = 0;
+        virtual void forget_all() = 0;
+
+        /// when set, run() also stops at an instruction that only jumps to
+        /// itself, so the machine can see the program has gone idle
+        bool stop_at_spins;
+};
+
+#endif
@@ -0,0 +1,103 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#include "cycle_pacer.hpp"
+
+#include <cstdlib>
+
+cycle_pacer::cycle_pacer(std::uint32_t clock_speed, double multiplier) : clock_speed(clock_speed), multiplier(multiplier), start(steady_clock::now()),
+    origin(start), origin_cycles(0), total_cycles(0), rate_start(start), rate_cycles(0), last_rate(0), rate_fresh(false)
+{
+}
+
+std::uint64_t cycle_pacer::due()
+{
+    if (unlimited())
+        return 0;
+
+    const double cycles_per_nsec = target_rate() / 1e9;
+
+    std::uint64_t nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(steady_clock::now() - origin).count();
+    std::uint64_t owed = static_cast<std::uint64_t>(nsec * cycles_per_nsec);
+    std::uint64_t done = total_cycles - origin_cycles;
+    if (owed <= done)
+        return 0;
+
+    // forgive whatever we owe beyond the maximum debt by moving the origin up
+    std::uint64_t max_debt = static_cast<std::uint64_t>(max_debt_nsec * cycles_per_nsec);
+    if (owed - done > max_debt) {
+        origin += std::chrono::nanoseconds(static_cast<std::uint64_t>((owed - done - max_debt) / cycles_per_nsec));
+        return max_debt;
+    }
+
+    return owed - done;
+}
+
+void cycle_pacer::executed(std::uint64_t cycles)
+{
+    total_cycles += cycles;
+    rate_cycles += cycles;
+
+    steady_clock::time_point now = steady_clock::now();
+    std::uint64_t nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(now - rate_start).count();
+    if (nsec >= rate_period_nsec) {
+        last_rate = rate_cycles * 1e9 / nsec;
+        rate_start = now;
+        rate_cycles = 0;
+        rate_fresh = true;
+    }
+}
+
+double cycle_pacer::average_rate() const
+{
+    double seconds = std::chrono::duration<double>(steady_clock::now() - start).count();
+    return seconds > 0 ? total_cycles / seconds : 0;
+}
+
+bool cycle_pacer::rate_updated()
+{
+    bool fresh = rate_fresh;
+    rate_fresh = false;
+    return fresh;
+}
+
+bool cycle_pacer::parse_speed(const std::string& text, double& multiplier)
+{
+    if (text == "unlimited" || text == "max") {
+        multiplier = 0;
+        return true;
+    }
+
+    // a trailing 'x' is allowed, as in "0.5x"
+    std::string number = text;
+    if (!number.empty() && (number[number.size() - 1] == 'x' || number[number.size() - 1] == 'X'))
+        number.erase(number.size() - 1);
+
+    const char* begin = number.c_str();
+    char* end;
+    double value = std::strtod(begin, &end);
+    if (end == begin || *end != '\0' || !(value > 0))
+        return false;
+
+    multiplier = value;
+    return true;
+}
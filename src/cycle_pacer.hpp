@@ -0,0 +1,84 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#ifndef CYCLE_PACER_HPP
+#define CYCLE_PACER_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/// works out how many cycles are due to keep the emulated clock in time with
+/// the host. time is measured in nanoseconds from a fixed origin, so cycles
+/// owed for partial slices are carried over instead of being truncated away
+class cycle_pacer {
+    public:
+        typedef std::chrono::steady_clock steady_clock;
+
+        /// a multiplier of zero (or less) means run unthrottled
+        cycle_pacer(std::uint32_t clock_speed, double multiplier);
+
+        bool unlimited() const { return multiplier <= 0; }
+
+        /// the number of cycles owed right now
+        std::uint64_t due();
+
+        /// records that cycles were actually executed
+        void executed(std::uint64_t cycles);
+
+        /// the clock rate we are aiming for, in Hz (zero when unthrottled)
+        double target_rate() const { return unlimited() ? 0 : clock_speed * multiplier; }
+
+        /// the clock rate achieved over the last measurement period, in Hz
+        double measured_rate() const { return last_rate; }
+
+        /// the clock rate achieved since the pacer was created, in Hz
+        double average_rate() const;
+
+        /// true once per measurement period, when measured_rate() was refreshed
+        bool rate_updated();
+
+        /// parses speeds like "2", "0.5x" or "unlimited" into a multiplier;
+        /// returns false if the string makes no sense
+        static bool parse_speed(const std::string& text, double& multiplier);
+    private:
+        // if the host stalls, we don't want to spend the next second catching up
+        static const std::uint64_t max_debt_nsec = 100000000;
+        static const std::uint64_t rate_period_nsec = 1000000000;
+
+        std::uint32_t clock_speed;
+        double multiplier;
+
+        steady_clock::time_point start;
+
+        // cycles are owed for all time since the origin, minus those already run
+        steady_clock::time_point origin;
+        std::uint64_t origin_cycles;
+        std::uint64_t total_cycles;
+
+        steady_clock::time_point rate_start;
+        std::uint64_t rate_cycles;
+        double last_rate;
+        bool rate_fresh;
+};
+
+#endif
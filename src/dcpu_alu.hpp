@@ -0,0 +1,86 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#ifndef DCPU_ALU_HPP
+#define DCPU_ALU_HPP
+
+#include "dcpu_decode.hpp"
+
+#include <cstdint>
+
+/// applies a basic opcode to b and a, as the spec has it, for saturn's own
+/// cores; returns false for a conditional that failed. shifts of 16 or more
+/// behave as if shifting bit by bit
+template <std::uint8_t op>
+inline bool alu(std::uint16_t& b, std::uint16_t a, std::uint16_t& ex)
+{
+    std::uint32_t x = b, y = a;
+    std::int32_t sx = static_cast<std::int16_t>(b), sy = static_cast<std::int16_t>(a);
+
+    switch (op) {
+        case instruction::SET: b = a; break;
+        case instruction::ADD: { std::uint32_t r = x + y; b = r; ex = r > 0xffff; break; }
+        case instruction::SUB: { std::int32_t r = std::int32_t(x) - std::int32_t(y); b = r; ex = r < 0 ? 0xffff : 0; break; }
+        case instruction::MUL: { std::uint32_t r = x * y; b = r; ex = r >> 16; break; }
+        case instruction::MLI: { std::int32_t r = sx * sy; b = r; ex = std::uint32_t(r) >> 16; break; }
+        case instruction::DIV:
+            if (y == 0) { b = 0; ex = 0; } else { b = x / y; ex = (x << 16) / y; }
+            break;
+        case instruction::DVI:
+            if (sy == 0) { b = 0; ex = 0; } else { b = sx / sy; ex = static_cast<std::uint16_t>((std::int64_t(sx) * 65536) / sy); }
+            break;
+        case instruction::MOD: b = y == 0 ? 0 : x % y; break;
+        case instruction::MDI: b = sy == 0 ? 0 : sx % sy; break;
+        case instruction::AND: b = x & y; break;
+        case instruction::BOR: b = x | y; break;
+        case instruction::XOR: b = x ^ y; break;
+        case instruction::SHR:
+            b = y > 15 ? 0 : x >> y;
+            ex = y > 31 ? 0 : static_cast<std::uint16_t>((x << 16) >> y);
+            break;
+        case instruction::ASR:
+            b = static_cast<std::uint16_t>(sx >> (y > 15 ? 15 : y));
+            ex = static_cast<std::uint16_t>((std::int64_t(sx) * 65536) >> (y > 31 ? 31 : y));
+            break;
+        case instruction::SHL: {
+            std::uint64_t r = y > 31 ? 0 : std::uint64_t(x) << y;
+            b = r;
+            ex = r >> 16;
+            break;
+        }
+        case instruction::IFB: return (x & y) != 0;
+        case instruction::IFC: return (x & y) == 0;
+        case instruction::IFE: return x == y;
+        case instruction::IFN: return x != y;
+        case instruction::IFG: return x > y;
+        case instruction::IFA: return sx > sy;
+        case instruction::IFL: return x < y;
+        case instruction::IFU: return sx < sy;
+        case instruction::ADX: { std::uint32_t r = x + y + ex; b = r; ex = r > 0xffff; break; }
+        case instruction::SBX: { std::int32_t r = std::int32_t(x) - std::int32_t(y) + std::int32_t(ex); b = r; ex = r < 0 ? 0xffff : (r > 0xffff ? 1 : 0); break; }
+        case instruction::STI:
+        case instruction::STD: b = a; break;
+    }
+    return true;
+}
+
+#endif
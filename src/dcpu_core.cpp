@@ -0,0 +1,240 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#include "dcpu_core.hpp"
+#include "dcpu_alu.hpp"
+
+dcpu_core::dcpu_core(galaxy::saturn::dcpu& cpu, device_schedule& schedule, const stop_points& stops) : cpu(cpu), schedule(schedule),
+    stops(stops), cache(0x10000)
+{
+    registers[0] = &cpu.A;
+    registers[1] = &cpu.B;
+    registers[2] = &cpu.C;
+    registers[3] = &cpu.X;
+    registers[4] = &cpu.Y;
+    registers[5] = &cpu.Z;
+    registers[6] = &cpu.I;
+    registers[7] = &cpu.J;
+
+    forget_all();
+}
+
+inline const dcpu_core::decoded& dcpu_core::fetch(std::uint16_t address)
+{
+    decoded& d = cache[address];
+
+    // an entry is only good while the words it was decoded from are still there
+    const std::array<std::uint16_t, 0x10000>& ram = cpu.ram;
+    bool valid = d.length != 0 && ram[address] == d.word;
+    if (valid && d.length > 1) {
+        std::uint16_t second = ram[static_cast<std::uint16_t>(address + 1)];
+        if (instruction::has_next_word(d.a))
+            valid = second == d.next_a && (d.length < 3 || ram[static_cast<std::uint16_t>(address + 2)] == d.next_b);
+        else
+            valid = second == d.next_b;
+    }
+
+    if (!valid)
+        decode_into(d, address);
+    return d;
+}
+
+inline std::uint16_t* dcpu_core::operand(std::uint8_t code, std::uint16_t next, bool is_a, std::uint16_t& literal)
+{
+    if (code < 0x08)
+        return registers[code];
+    if (code < 0x10)
+        return &cpu.ram[*registers[code - 0x08]];
+    if (code < 0x18)
+        return &cpu.ram[static_cast<std::uint16_t>(*registers[code - 0x10] + next)];
+
+    switch (code) {
+        case instruction::PUSH_POP:
+            return is_a ? &cpu.ram[cpu.SP++] : &cpu.ram[--cpu.SP];
+        case instruction::PEEK:
+            return &cpu.ram[cpu.SP];
+        case instruction::PICK:
+            return &cpu.ram[static_cast<std::uint16_t>(cpu.SP + next)];
+        case instruction::SP:
+            return &cpu.SP;
+        case instruction::PC:
+            return &cpu.PC;
+        case instruction::EX:
+            return &cpu.EX;
+        case instruction::NEXT_WORD_ADDRESS:
+            return &cpu.ram[next];
+        case instruction::NEXT_WORD:
+            literal = next;
+            return &literal;
+    }
+
+    // short literals, -1 to 30
+    literal = static_cast<std::uint16_t>(code - instruction::SHORT_LITERAL - 1);
+    return &literal;
+}
+
+void dcpu_core::step()
+{
+    // libsaturn delivers queued interrupts at the start of a cycle, and only
+    // it can see whether there are any
+    if (cpu.IA != 0 || !fetch(cpu.PC).execute)
+        cpu.cycle();
+    else
+        execute_fetched();
+}
+
+void dcpu_core::run(std::uint64_t budget, std::uint64_t& done)
+{
+    while (done < budget && cpu.IA == 0) {
+        const decoded& d = fetch(cpu.PC);
+        if (!d.execute || d.stops || (d.spins && stop_at_spins))
+            break;
+        execute_fetched();
+        done++;
+    }
+}
+
+void dcpu_core::forget(std::uint16_t address)
+{
+    cache[address].length = 0;
+}
+
+void dcpu_core::forget_all()
+{
+    for (std::size_t i = 0; i < cache.size(); i++)
+        cache[i].length = 0;
+}
+
+void dcpu_core::execute_fetched()
+{
+    schedule.tick();
+
+    // a device (a floppy finishing a read, say) may have just written over
+    // the instruction; if it's now one only libsaturn can run, the devices
+    // get ticked twice this cycle, which is the best we can do
+    const decoded& d = fetch(cpu.PC);
+    if (d.execute)
+        d.execute(*this, d);
+    else
+        cpu.cycle();
+}
+
+void dcpu_core::decode_into(decoded& d, std::uint16_t address)
+{
+    instruction ins = decode(cpu.ram, address);
+    d.word = cpu.ram[address];
+    d.next_a = ins.next_a;
+    d.next_b = ins.next_b;
+    d.a = ins.a;
+    d.b = ins.b;
+    d.length = ins.length;
+    d.spins = ins.is_self_jump();
+    d.stops = stops.might_stop(ins);
+    d.execute = 0;
+
+    if (!ins.is_valid())
+        return;
+
+    if (ins.is_special()) {
+        switch (ins.special) {
+            case instruction::JSR: d.execute = &dcpu_core::jsr; break;
+            case instruction::IAG: d.execute = &dcpu_core::iag; break;
+            case instruction::IAS: d.execute = &dcpu_core::ias; break;
+        }
+        return;
+    }
+
+    static const handler basic_handlers[0x20] = {
+        0, &basic<0x01>, &basic<0x02>, &basic<0x03>, &basic<0x04>, &basic<0x05>, &basic<0x06>, &basic<0x07>,
+        &basic<0x08>, &basic<0x09>, &basic<0x0a>, &basic<0x0b>, &basic<0x0c>, &basic<0x0d>, &basic<0x0e>, &basic<0x0f>,
+        &basic<0x10>, &basic<0x11>, &basic<0x12>, &basic<0x13>, &basic<0x14>, &basic<0x15>, &basic<0x16>, &basic<0x17>,
+        0, 0, &basic<0x1a>, &basic<0x1b>, 0, 0, &basic<0x1e>, &basic<0x1f>
+    };
+    d.execute = basic_handlers[ins.opcode];
+}
+
+void dcpu_core::skip()
+{
+    // each skipped conditional takes the one after it along with it
+    bool conditional;
+    do {
+        const decoded& next = fetch(cpu.PC);
+        std::uint8_t opcode = next.word & 0x1f;
+        cpu.PC += next.length;
+        conditional = opcode >= instruction::IFB && opcode <= instruction::IFU;
+    } while (conditional);
+}
+
+template <std::uint8_t op>
+void dcpu_core::basic(dcpu_core& core, const decoded& d)
+{
+    // PC moves past each word as it's read, which shows if an operand is PC
+    galaxy::saturn::dcpu& cpu = core.cpu;
+    std::uint16_t address = cpu.PC;
+    std::uint16_t a_literal, b_literal;
+
+    cpu.PC = address + 1 + instruction::has_next_word(d.a);
+    std::uint16_t a = *core.operand(d.a, d.next_a, true, a_literal);
+    cpu.PC = address + d.length;
+    std::uint16_t* b = core.operand(d.b, d.next_b, false, b_literal);
+
+    if (!alu<op>(*b, a, cpu.EX))
+        core.skip();
+
+    if (op == instruction::STI) {
+        cpu.I++;
+        cpu.J++;
+    } else if (op == instruction::STD) {
+        cpu.I--;
+        cpu.J--;
+    }
+}
+
+void dcpu_core::jsr(dcpu_core& core, const decoded& d)
+{
+    galaxy::saturn::dcpu& cpu = core.cpu;
+    std::uint16_t address = cpu.PC;
+    std::uint16_t literal;
+
+    cpu.PC = address + d.length;
+    std::uint16_t target = *core.operand(d.a, d.next_a, true, literal);
+    cpu.ram[--cpu.SP] = cpu.PC;
+    cpu.PC = target;
+}
+
+void dcpu_core::iag(dcpu_core& core, const decoded& d)
+{
+    galaxy::saturn::dcpu& cpu = core.cpu;
+    std::uint16_t literal;
+
+    cpu.PC += d.length;
+    *core.operand(d.a, d.next_a, true, literal) = cpu.IA;
+}
+
+void dcpu_core::ias(dcpu_core& core, const decoded& d)
+{
+    galaxy::saturn::dcpu& cpu = core.cpu;
+    std::uint16_t literal;
+
+    cpu.PC += d.length;
+    cpu.IA = *core.operand(d.a, d.next_a, true, literal);
+}
@@ -0,0 +1,108 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#ifndef DCPU_CORE_HPP
+#define DCPU_CORE_HPP
+
+#include <libsaturn.hpp>
+
+#include "cpu_core.hpp"
+#include "device_schedule.hpp"
+#include "stop_points.hpp"
+#include "dcpu_decode.hpp"
+
+#include <cstdint>
+#include <vector>
+
+/// saturn's cached interpreter: instructions are decoded once into a cache
+/// keyed by address, along with a pointer to the handler for their opcode;
+/// each entry remembers the words it was decoded from and is decoded again if
+/// they change, so self-modifying code (and devices writing to memory) still
+/// works.
+///
+/// like dcpu::cycle(), a step runs one whole instruction and ticks the
+/// devices, though only those device_schedule has awake. anything involving
+/// state libsaturn keeps to itself is handed to dcpu::cycle(): the interrupt
+/// queue (so every step while IA is set), RFI and IAQ, and the hardware
+/// instructions. invalid opcodes are handed over too, so they throw just as
+/// they would have
+class dcpu_core : public cpu_core {
+    public:
+        /// the devices are ticked through schedule
+        dcpu_core(galaxy::saturn::dcpu& cpu, device_schedule& schedule, const stop_points& stops);
+
+        void step();
+        void run(std::uint64_t budget, std::uint64_t& done);
+        void forget(std::uint16_t address);
+        void forget_all();
+    private:
+        struct decoded;
+        typedef void (*handler)(dcpu_core& core, const decoded& d);
+
+        /// an instruction as decoded at some address; execute is null for
+        /// anything libsaturn has to run, and length is zero for an empty
+        /// entry. spins is set for an instruction that only jumps to itself,
+        /// and stops for one the stop points might stop at
+        struct decoded {
+            handler execute;
+            std::uint16_t word;
+            std::uint16_t next_a;
+            std::uint16_t next_b;
+            std::uint8_t a;
+            std::uint8_t b;
+            std::uint8_t length;
+            bool spins;
+            bool stops;
+        };
+
+        const decoded& fetch(std::uint16_t address);
+
+        /// ticks the devices and runs the instruction at PC, which was just
+        /// fetched with a handler
+        void execute_fetched();
+        void decode_into(decoded& d, std::uint16_t address);
+
+        /// where an operand reads from and writes to; literals are stored in
+        /// literal, so writes to them go nowhere. evaluating it has the
+        /// operand's side effects on SP
+        std::uint16_t* operand(std::uint8_t code, std::uint16_t next, bool is_a, std::uint16_t& literal);
+
+        /// steps PC over the instruction at PC, and any conditionals chained
+        /// after it
+        void skip();
+
+        template <std::uint8_t op> static void basic(dcpu_core& core, const decoded& d);
+        static void jsr(dcpu_core& core, const decoded& d);
+        static void iag(dcpu_core& core, const decoded& d);
+        static void ias(dcpu_core& core, const decoded& d);
+
+        galaxy::saturn::dcpu& cpu;
+        device_schedule& schedule;
+        const stop_points& stops;
+        std::uint16_t* registers[8];
+        std::vector<decoded> cache;
+
+        dcpu_core(const dcpu_core&);
+        dcpu_core& operator=(const dcpu_core&);
+};
+
+#endif
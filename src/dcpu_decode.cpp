@@ -0,0 +1,128 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#include "dcpu_decode.hpp"
+
+instruction decode(const std::array<std::uint16_t, 0x10000>& ram, std::uint16_t address)
+{
+    std::uint16_t word = ram[address];
+
+    instruction ins;
+    ins.address = address;
+    ins.opcode = word & 0x1f;
+    ins.b = (word >> 5) & 0x1f;
+    ins.a = (word >> 10) & 0x3f;
+    ins.special = ins.is_special() ? ins.b : 0;
+    ins.next_a = 0;
+    ins.next_b = 0;
+    ins.length = 1;
+
+    // the a operand's word comes first, since a is evaluated first
+    if (instruction::has_next_word(ins.a))
+        ins.next_a = ram[static_cast<std::uint16_t>(address + ins.length++)];
+    if (!ins.is_special() && instruction::has_next_word(ins.b))
+        ins.next_b = ram[static_cast<std::uint16_t>(address + ins.length++)];
+
+    return ins;
+}
+
+std::uint16_t peek_operand(const galaxy::saturn::dcpu& cpu, std::uint8_t operand, std::uint16_t next)
+{
+    if (operand < 0x08)
+        return register_at(cpu, operand);
+    if (operand < 0x10)
+        return cpu.ram[register_at(cpu, operand - 0x08)];
+    if (operand < 0x18)
+        return cpu.ram[static_cast<std::uint16_t>(register_at(cpu, operand - 0x10) + next)];
+
+    switch (operand) {
+        case instruction::PUSH_POP:
+        case instruction::PEEK:
+            return cpu.ram[cpu.SP];
+        case instruction::PICK:
+            return cpu.ram[static_cast<std::uint16_t>(cpu.SP + next)];
+        case instruction::SP:
+            return cpu.SP;
+        case instruction::PC:
+            return cpu.PC;
+        case instruction::EX:
+            return cpu.EX;
+        case instruction::NEXT_WORD_ADDRESS:
+            return cpu.ram[next];
+        case instruction::NEXT_WORD:
+            return next;
+    }
+
+    // short literals, -1 to 30
+    return static_cast<std::uint16_t>(operand - instruction::SHORT_LITERAL - 1);
+}
+
+bool written_address(const galaxy::saturn::dcpu& cpu, const instruction& ins, std::uint16_t& address)
+{
+    if (ins.is_special() && ins.special == instruction::JSR) {
+        address = static_cast<std::uint16_t>(cpu.SP - 1);
+        return true;
+    }
+
+    std::uint8_t operand;
+    std::uint16_t next;
+    if (!ins.written_operand(operand, next) || !instruction::is_memory(operand))
+        return false;
+
+    // a is evaluated first, so a POP there has moved SP by the time b is
+    std::uint16_t sp = cpu.SP;
+    if (!ins.is_special() && ins.a == instruction::PUSH_POP)
+        sp++;
+
+    if (operand < 0x10)
+        address = register_at(cpu, operand - 0x08);
+    else if (operand < 0x18)
+        address = static_cast<std::uint16_t>(register_at(cpu, operand - 0x10) + next);
+    else if (operand == instruction::PUSH_POP)
+        address = ins.is_special() ? sp : static_cast<std::uint16_t>(sp - 1);
+    else if (operand == instruction::PEEK)
+        address = sp;
+    else if (operand == instruction::PICK)
+        address = static_cast<std::uint16_t>(sp + next);
+    else
+        address = next;
+    return true;
+}
+
+std::uint16_t& register_at(galaxy::saturn::dcpu& cpu, std::uint8_t index)
+{
+    switch (index) {
+        case 0: return cpu.A;
+        case 1: return cpu.B;
+        case 2: return cpu.C;
+        case 3: return cpu.X;
+        case 4: return cpu.Y;
+        case 5: return cpu.Z;
+        case 6: return cpu.I;
+    }
+    return cpu.J;
+}
+
+std::uint16_t register_at(const galaxy::saturn::dcpu& cpu, std::uint8_t index)
+{
+    return register_at(const_cast<galaxy::saturn::dcpu&>(cpu), index);
+}
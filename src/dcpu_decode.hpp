@@ -0,0 +1,146 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#ifndef DCPU_DECODE_HPP
+#define DCPU_DECODE_HPP
+
+#include <libsaturn.hpp>
+
+#include <array>
+#include <cstdint>
+
+/// a DCPU-16 instruction split into its fields. libsaturn decodes as it
+/// executes and keeps that to itself, so anything in saturn that needs to know
+/// what the program is about to do (watching HWIs, profiling, debugging)
+/// decodes the instruction at PC for itself with this
+struct instruction {
+    // basic opcodes
+    static const std::uint8_t SET = 0x01, ADD = 0x02, SUB = 0x03, MUL = 0x04, MLI = 0x05, DIV = 0x06, DVI = 0x07,
+        MOD = 0x08, MDI = 0x09, AND = 0x0a, BOR = 0x0b, XOR = 0x0c, SHR = 0x0d, ASR = 0x0e, SHL = 0x0f,
+        IFB = 0x10, IFC = 0x11, IFE = 0x12, IFN = 0x13, IFG = 0x14, IFA = 0x15, IFL = 0x16, IFU = 0x17,
+        ADX = 0x1a, SBX = 0x1b, STI = 0x1e, STD = 0x1f;
+
+    // special opcodes, found in the b field when the basic opcode is zero
+    static const std::uint8_t JSR = 0x01, INT = 0x08, IAG = 0x09, IAS = 0x0a, RFI = 0x0b, IAQ = 0x0c,
+        HWN = 0x10, HWQ = 0x11, HWI = 0x12;
+
+    // operand codes
+    static const std::uint8_t PUSH_POP = 0x18, PEEK = 0x19, PICK = 0x1a, SP = 0x1b, PC = 0x1c, EX = 0x1d,
+        NEXT_WORD_ADDRESS = 0x1e, NEXT_WORD = 0x1f, SHORT_LITERAL = 0x20;
+
+    /// the low ten bits of an instruction word that make it a HWI, whatever
+    /// its operand
+    static const std::uint16_t HWI_MASK = 0x3ff;
+    static const std::uint16_t HWI_WORD = HWI << 5;
+
+    std::uint16_t address;
+    std::uint8_t opcode;
+    std::uint8_t special;
+    std::uint8_t a, b;
+    std::uint16_t next_a, next_b;
+    std::uint8_t length;
+
+    bool is_special() const { return opcode == 0; }
+    bool is_conditional() const { return opcode >= IFB && opcode <= IFU; }
+    /// whether the opcode is one the spec defines; libsaturn throws
+    /// invalid_opcode on anything else
+    bool is_valid() const { return is_valid_word(static_cast<std::uint16_t>(opcode | (b << 5))); }
+
+    /// the same check on a bare instruction word
+    static bool is_valid_word(std::uint16_t word)
+    {
+        std::uint8_t op = word & 0x1f;
+        if (op == 0) {
+            std::uint8_t special = (word >> 5) & 0x1f;
+            return special == JSR || (special >= INT && special <= IAQ) || (special >= HWN && special <= HWI);
+        }
+        return op <= IFU || op == ADX || op == SBX || op == STI || op == STD;
+    }
+
+    /// whether running it only ever brings PC straight back to it, as with
+    /// "SET PC, itself", "SUB PC, 1" and the like
+    bool is_self_jump() const
+    {
+        if (is_special() || b != PC)
+            return false;
+
+        std::uint16_t value;
+        if (a == NEXT_WORD)
+            value = next_a;
+        else if (a >= SHORT_LITERAL)
+            value = static_cast<std::uint16_t>(a - SHORT_LITERAL - 1);
+        else
+            return false;
+
+        return (opcode == SET && value == address) || (opcode == SUB && value == length)
+            || (opcode == ADD && static_cast<std::uint16_t>(value + length) == 0);
+    }
+
+    /// the operand the instruction writes to: b for the basic opcodes other
+    /// than the conditionals, a for IAG and HWN. returns false if there's
+    /// none, which includes JSR, whose write is a push
+    bool written_operand(std::uint8_t& operand, std::uint16_t& next) const
+    {
+        if (is_special()) {
+            if (special != IAG && special != HWN)
+                return false;
+            operand = a;
+            next = next_a;
+        } else {
+            if (is_conditional())
+                return false;
+            operand = b;
+            next = next_b;
+        }
+        return true;
+    }
+
+    /// whether an operand code refers to a word of memory
+    static bool is_memory(std::uint8_t operand)
+    {
+        return (operand >= 0x08 && operand <= PICK) || operand == NEXT_WORD_ADDRESS;
+    }
+
+    /// whether an operand code takes a word following the instruction
+    static bool has_next_word(std::uint8_t operand)
+    {
+        return (operand >= 0x10 && operand <= 0x17) || operand == PICK || operand == NEXT_WORD_ADDRESS || operand == NEXT_WORD;
+    }
+};
+
+/// decodes the instruction at address, without executing anything
+instruction decode(const std::array<std::uint16_t, 0x10000>& ram, std::uint16_t address);
+
+/// what an a operand currently evaluates to, without any of its side effects
+/// (a POP here doesn't move SP, and PC reads as the instruction's own address)
+std::uint16_t peek_operand(const galaxy::saturn::dcpu& cpu, std::uint8_t operand, std::uint16_t next);
+
+/// the word of memory the instruction at PC would write to if it ran now,
+/// pushes included. false if it doesn't write to memory itself (an interrupt
+/// it lets in, or a device it sends to, may still do so)
+bool written_address(const galaxy::saturn::dcpu& cpu, const instruction& ins, std::uint16_t& address);
+
+/// the general purpose registers in operand order: A, B, C, X, Y, Z, I, J
+std::uint16_t& register_at(galaxy::saturn::dcpu& cpu, std::uint8_t index);
+std::uint16_t register_at(const galaxy::saturn::dcpu& cpu, std::uint8_t index);
+
+#endif
@@ -0,0 +1,143 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#include "device_schedule.hpp"
+
+#include <algorithm>
+#include <limits>
+
+static const std::uint64_t forever = std::numeric_limits<std::uint64_t>::max();
+
+device_schedule::device_schedule(const std::vector<galaxy::saturn::device*>& devices, const galaxy::saturn::device* clock,
+    const galaxy::saturn::device* keyboard, const std::vector<galaxy::saturn::device*>& drives) : clock(clock), keyboard(keyboard),
+    active_awake(0), sleeping(false), now(0), next_expiry(forever)
+{
+    // a device has at most one entry, so the schedule doesn't allocate as
+    // devices wake and sleep
+    std::vector<expiry> storage;
+    storage.reserve(devices.size());
+    expiries = std::priority_queue<expiry, std::vector<expiry>, std::greater<expiry> >(std::greater<expiry>(), std::move(storage));
+    awake.reserve(devices.size());
+
+    for (std::size_t i = 0; i < devices.size(); i++) {
+        slot s;
+        s.device = devices[i];
+        s.until = devices[i] == keyboard ? forever : 0;
+        s.active = devices[i] == clock || std::find(drives.begin(), drives.end(), devices[i]) != drives.end();
+        s.queued = false;
+        slots.push_back(s);
+    }
+    rebuild();
+}
+
+void device_schedule::hwi(std::uint16_t index, std::uint16_t a, std::uint16_t b)
+{
+    if (index >= slots.size())
+        return;
+
+    slot& s = slots[index];
+    if (s.device == clock && a == 0) {
+        // SET_INTERVAL: a non-zero interval starts the clock, which then needs
+        // ticking until it's stopped; once stopped it winds down like anything else
+        set(index, b != 0 ? forever : now + wake_cycles);
+    } else if (s.until != forever) {
+        set(index, std::max(s.until, now + wake_cycles));
+    }
+}
+
+void device_schedule::let_sleep(bool sleep)
+{
+    sleeping = sleep;
+    rebuild();
+}
+
+void device_schedule::idle(std::uint64_t cycles)
+{
+    while (cycles > 0 && (next_expiry != forever || !sleeping)) {
+        std::uint64_t ticks = std::min(cycles, next_expiry - now);
+        for (std::uint64_t t = 0; t < ticks; t++) {
+            for (std::size_t i = 0; i < awake.size(); i++) {
+                if (awake[i] != keyboard)
+                    awake[i]->cycle();
+            }
+        }
+        cycles -= ticks;
+        elapse(ticks);
+    }
+    now += cycles;
+}
+
+void device_schedule::set(std::size_t index, std::uint64_t until)
+{
+    slot& s = slots[index];
+    bool was_awake = s.until > now;
+
+    // until only ever moves later, except for the clock being stopped, and
+    // then an entry left from before it was started is already due sooner;
+    // either way the entry that's there comes up in time to be put back
+    s.until = until;
+    if (until != forever && !s.queued) {
+        expiries.push(expiry(until, index));
+        s.queued = true;
+        next_expiry = expiries.top().first;
+    }
+    if (!was_awake)
+        rebuild();
+}
+
+void device_schedule::expire()
+{
+    bool changed = false;
+    while (!expiries.empty() && expiries.top().first <= now) {
+        std::size_t index = expiries.top().second;
+        slot& s = slots[index];
+        expiries.pop();
+        s.queued = false;
+
+        // woken again since the entry was made: put it back for the new time
+        if (s.until > now) {
+            if (s.until != forever) {
+                expiries.push(expiry(s.until, index));
+                s.queued = true;
+            }
+            continue;
+        }
+        changed = true;
+    }
+
+    next_expiry = expiries.empty() ? forever : expiries.top().first;
+    if (changed)
+        rebuild();
+}
+
+void device_schedule::rebuild()
+{
+    awake.clear();
+    active_awake = 0;
+    for (std::size_t i = 0; i < slots.size(); i++) {
+        bool woken = slots[i].until > now;
+        if (woken || !sleeping)
+            awake.push_back(slots[i].device);
+        if (woken)
+            active_awake += slots[i].active;
+    }
+}
@@ -0,0 +1,142 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#ifndef DEVICE_SCHEDULE_HPP
+#define DEVICE_SCHEDULE_HPP
+
+#include <libsaturn.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+/// which devices saturn's cores tick with each instruction. by the spec a
+/// device only has anything to do in cycle() for a while after it's been told
+/// to do something (a floppy read in flight, a LEM1802 starting up, a SPED-3
+/// turning) or, for the clock, while it's running; the rest of the time
+/// cycle() is wasted. with let_sleep, a device that's asleep isn't ticked at
+/// all; otherwise, as by default, every device is, asleep or not.
+///
+/// an HWI wakes its device for wake_cycles, which is longer than any of that
+/// takes; the clock stays awake for as long as its interval isn't zero, and
+/// the keyboard always is, since keys arrive from the host at any time. when
+/// libsaturn runs an instruction itself it ticks every device, asleep or not.
+///
+/// the clock and the floppy drives are the devices that can change what the
+/// cpu sees by themselves, with an interrupt or by writing to memory; while
+/// neither is awake the schedule is passive, and a program waiting in a loop
+/// has nothing to wait for but the host
+class device_schedule {
+    public:
+        /// by the spec the longest of those is a SPED-3 turning half way round
+        /// at 50 degrees a second, about 3.6 seconds. that libsaturn's devices
+        /// keep to it is an assumption that hasn't been checked against them:
+        /// one that takes longer, or does anything in cycle() without an HWI
+        /// first, would be left asleep part way through, which is why sleeping
+        /// devices are still ticked unless let_sleep says otherwise.
+        /// saturn_difftest --sleep-devices run against the real libsaturn,
+        /// which ticks every device, would show whether it's safe
+        static const std::uint64_t wake_cycles = 10 * galaxy::saturn::dcpu::clock_speed;
+
+        /// devices must be in hardware index order
+        device_schedule(const std::vector<galaxy::saturn::device*>& devices, const galaxy::saturn::device* clock,
+            const galaxy::saturn::device* keyboard, const std::vector<galaxy::saturn::device*>& drives);
+
+        /// called before an HWI to the device at index is run, with the A
+        /// and B it's about to see
+        void hwi(std::uint16_t index, std::uint16_t a, std::uint16_t b);
+
+        /// whether devices that are asleep go unticked; off to begin with
+        void let_sleep(bool sleep);
+
+        /// ticks every awake device once, as a cpu does each instruction
+        void tick()
+        {
+            for (std::size_t i = 0; i < awake.size(); i++)
+                awake[i]->cycle();
+            if (++now >= next_expiry)
+                expire();
+        }
+
+        /// lets cycles go by as libsaturn ticks the devices itself
+        void elapse(std::uint64_t cycles)
+        {
+            now += cycles;
+            if (now >= next_expiry)
+                expire();
+        }
+
+        /// lets cycles go by with the cpu idle, while the schedule is passive:
+        /// the awake devices other than the keyboard are ticked until they go
+        /// back to sleep, and, if they're let sleep, the rest is skipped at
+        /// once. the keyboard only has anything to do once a key arrives,
+        /// which ends the idling
+        void idle(std::uint64_t cycles);
+
+        bool passive() const { return active_awake == 0; }
+
+        /// ticks so far, counting those elapsed and idled through
+        std::uint64_t ticks() const { return now; }
+    private:
+        typedef std::pair<std::uint64_t, std::size_t> expiry;
+
+        /// the device, and the tick it can go back to sleep at
+        struct slot {
+            galaxy::saturn::device* device;
+            std::uint64_t until;
+            /// the clock or a drive
+            bool active;
+            /// whether the device has its entry in expiries; it never has more
+            /// than one, and that one never comes up later than until
+            bool queued;
+        };
+
+        /// changes when the device at index goes back to sleep, keeping to one
+        /// entry in expiries for every device
+        void set(std::size_t index, std::uint64_t until);
+        void expire();
+        void rebuild();
+
+        std::vector<slot> slots;
+        const galaxy::saturn::device* clock;
+        const galaxy::saturn::device* keyboard;
+
+        /// the devices ticked with each instruction, in hardware index order:
+        /// those with until in the future, or all of them unless sleeping.
+        /// active_awake only counts the first
+        std::vector<galaxy::saturn::device*> awake;
+        std::size_t active_awake;
+        bool sleeping;
+
+        /// soonest first; an entry that comes up early (the device having been
+        /// woken again since) is put back for the new time, and one that comes
+        /// up for a device running until it's stopped is dropped
+        std::priority_queue<expiry, std::vector<expiry>, std::greater<expiry> > expiries;
+
+        /// ticks so far, and the soonest entry in expiries
+        std::uint64_t now;
+        std::uint64_t next_expiry;
+};
+
+#endif
@@ -0,0 +1,451 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+/* libsaturn */
+#include <libsaturn.hpp>
+
+/* implementation specific */
+#include "machine.hpp"
+#include "loader.hpp"
+#include "input_log.hpp"
+#include "dcpu_decode.hpp"
+
+/* standard library */
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* third party */
+#include "OptionParser.h"
+
+// a program to run on both sides: the contents of memory it starts with
+struct program {
+    std::string name;
+    std::vector<std::uint16_t> ram;
+};
+
+// one side of the comparison: a machine and the input it's fed
+struct lane {
+    std::unique_ptr<machine> m;
+    input_log input;
+    bool has_input;
+    bool crashed;
+};
+
+// the log has already been checked to load
+static void make_lane(lane& l, cpu_backend backend, const program& p, const std::string& log, bool sleep)
+{
+    l.m.reset(new machine(1, 1, std::list<std::string>(), disk_backend::fstream, backend));
+    // the device configuration is tracked from HWIs, so it can be compared too
+    l.m->watch_hwi = true;
+    // every instruction should go through the backend under test
+    l.m->fast_forward = false;
+    l.m->let_devices_sleep(sleep);
+    std::copy(p.ram.begin(), p.ram.end(), l.m->cpu.ram.begin());
+    l.has_input = log != "";
+    l.crashed = false;
+    if (l.has_input)
+        l.input.load(log);
+}
+
+// runs a lane on until it's executed target cycles, feeding it its input on
+// the way; each event goes in just before the cycle it was recorded at
+static void advance(lane& l, std::uint64_t target)
+{
+    machine& m = *l.m;
+    while (!l.crashed && m.cycles < target) {
+        std::uint64_t end = target;
+        std::uint64_t due;
+        if (l.has_input && l.input.next(due) && due < end) {
+            if (due <= m.cycles) {
+                l.input.replay(*m.keyboard);
+                continue;
+            }
+            end = due;
+        }
+
+        run_result result = m.run(end - m.cycles);
+        m.cycles += result.cycles;
+        l.crashed = is_final(result.reason);
+    }
+}
+
+// everything that's compared at a checkpoint: the registers, a hash of memory
+// and the device configuration the program has set up
+struct state {
+    std::vector<std::uint16_t> registers;
+    std::uint64_t ram_hash;
+    std::vector<std::uint16_t> devices;
+    std::uint64_t cycles;
+    bool crashed;
+
+    bool operator==(const state& other) const
+    {
+        return registers == other.registers && ram_hash == other.ram_hash && devices == other.devices
+            && cycles == other.cycles && crashed == other.crashed;
+    }
+};
+
+static const char* register_names[] = { "A", "B", "C", "X", "Y", "Z", "I", "J", "PC", "SP", "EX", "IA" };
+
+static state capture(const lane& l)
+{
+    const machine& m = *l.m;
+    const galaxy::saturn::dcpu& cpu = m.cpu;
+
+    state s;
+    std::uint16_t registers[] = { cpu.A, cpu.B, cpu.C, cpu.X, cpu.Y, cpu.Z, cpu.I, cpu.J, cpu.PC, cpu.SP, cpu.EX, cpu.IA };
+    s.registers.assign(registers, registers + 12);
+
+    // FNV-1a
+    s.ram_hash = 14695981039346656037ull;
+    for (std::size_t i = 0; i < cpu.ram.size(); i++) {
+        s.ram_hash = (s.ram_hash ^ (cpu.ram[i] & 0xff)) * 1099511628211ull;
+        s.ram_hash = (s.ram_hash ^ (cpu.ram[i] >> 8)) * 1099511628211ull;
+    }
+
+    for (std::size_t i = 0; i < m.lem_mappings.size(); i++) {
+        const lem_mapping& lem = m.lem_mappings[i];
+        std::uint16_t fields[] = { lem.screen, lem.font, lem.palette, lem.border };
+        s.devices.insert(s.devices.end(), fields, fields + 4);
+    }
+    for (std::size_t i = 0; i < m.sped_mappings.size(); i++) {
+        const sped_mapping& sped = m.sped_mappings[i];
+        std::uint16_t fields[] = { sped.address, sped.count, sped.rotation };
+        s.devices.insert(s.devices.end(), fields, fields + 3);
+    }
+    s.devices.push_back(m.clock_interval);
+    s.devices.push_back(m.clock_message);
+    s.devices.push_back(m.keyboard_message);
+    s.devices.insert(s.devices.end(), m.drive_messages.begin(), m.drive_messages.end());
+
+    s.cycles = m.cycles;
+    s.crashed = l.crashed;
+    return s;
+}
+
+static void print_words(std::ostream& out, const galaxy::saturn::dcpu& cpu, std::uint16_t address)
+{
+    instruction ins = decode(cpu.ram, address);
+    out << "0x" << std::hex << std::setfill('0') << std::setw(4) << address << ":";
+    for (std::uint8_t i = 0; i < ins.length; i++)
+        out << " " << std::setw(4) << cpu.ram[static_cast<std::uint16_t>(address + i)];
+    out << std::dec << std::setfill(' ');
+}
+
+// spells out how the candidate differs from the reference
+static void describe(std::ostream& out, const lane& reference, const lane& candidate)
+{
+    state r = capture(reference);
+    state c = capture(candidate);
+
+    if (r.crashed != c.crashed || r.cycles != c.cycles)
+        out << "    " << (r.crashed ? "reference" : "candidate") << " stopped (an invalid opcode or the halt HWI) after " << std::min(r.cycles, c.cycles) << " cycles, the other didn't" << std::endl;
+
+    for (std::size_t i = 0; i < r.registers.size(); i++) {
+        if (r.registers[i] != c.registers[i])
+            out << "    " << register_names[i] << ": 0x" << std::hex << r.registers[i] << " vs 0x" << c.registers[i] << std::dec << std::endl;
+    }
+
+    const std::array<std::uint16_t, 0x10000>& r_ram = reference.m->cpu.ram;
+    const std::array<std::uint16_t, 0x10000>& c_ram = candidate.m->cpu.ram;
+    int shown = 0;
+    for (std::size_t i = 0; i < r_ram.size() && shown < 8; i++) {
+        if (r_ram[i] != c_ram[i]) {
+            out << "    [0x" << std::hex << i << "]: 0x" << r_ram[i] << " vs 0x" << c_ram[i] << std::dec << std::endl;
+            shown++;
+        }
+    }
+
+    if (r.devices != c.devices)
+        out << "    device configuration differs" << std::endl;
+}
+
+// runs the reference and a candidate backend side by side, comparing them every
+// interval cycles. when they first disagree, both are run again from the start
+// to the last checkpoint they agreed at, then stepped one instruction at a
+// time to find the one that went wrong. with sleep, the candidate's devices
+// are let sleep. prints what happened to out, and returns false if they
+// diverged
+static bool compare(const program& p, cpu_backend backend, std::uint64_t cycles, std::uint64_t interval, const std::string& log, bool sleep,
+    std::ostream& out)
+{
+    lane reference, candidate;
+    make_lane(reference, cpu_backend::reference, p, log, false);
+    make_lane(candidate, backend, p, log, sleep);
+
+    std::uint64_t good = 0;
+    while (good < cycles) {
+        std::uint64_t target = std::min(good + interval, cycles);
+        advance(reference, target);
+        advance(candidate, target);
+        if (!(capture(reference) == capture(candidate)))
+            break;
+
+        good = target;
+        if (reference.crashed)
+            break;
+    }
+
+    if (good >= cycles || reference.crashed) {
+        out << std::left << std::setw(24) << p.name << std::setw(12) << cpu_backend_name(backend) << std::right
+            << "ok after " << reference.m->cycles << " cycles" << (reference.crashed ? " (both stopped)" : "") << std::endl;
+        return true;
+    }
+
+    // the machines are deterministic, so a second run gets to the checkpoint
+    // in exactly the same state
+    make_lane(reference, cpu_backend::reference, p, log, false);
+    make_lane(candidate, backend, p, log, sleep);
+    advance(reference, good);
+    advance(candidate, good);
+
+    std::uint64_t cycle = good;
+    std::uint16_t pc = reference.m->cpu.PC;
+    for (; cycle < good + interval; cycle++) {
+        pc = reference.m->cpu.PC;
+        advance(reference, cycle + 1);
+        advance(candidate, cycle + 1);
+        if (!(capture(reference) == capture(candidate)))
+            break;
+    }
+
+    out << std::left << std::setw(24) << p.name << std::setw(12) << cpu_backend_name(backend) << std::right
+        << "DIVERGED at cycle " << cycle << ", running ";
+    print_words(out, reference.m->cpu, pc);
+    out << std::endl;
+    describe(out, reference, candidate);
+    return false;
+}
+
+static bool load_program(const std::string& name, const std::string& filename, program& p)
+{
+    // the loader writes straight into a dcpu's memory
+    std::unique_ptr<galaxy::saturn::dcpu> scratch (new galaxy::saturn::dcpu());
+    scratch->ram.fill(0);
+    if (!load_binary(*scratch, filename))
+        return false;
+
+    p.name = name;
+    p.ram.assign(scratch->ram.begin(), scratch->ram.end());
+    return true;
+}
+
+// memory full of mostly valid instructions, with the odd HWI, interrupt
+// instruction and arbitrary word (which doubles as data and as a next word)
+static program random_program(std::uint32_t seed)
+{
+    static const std::uint8_t basic[] = {
+        instruction::SET, instruction::ADD, instruction::SUB, instruction::MUL, instruction::MLI, instruction::DIV, instruction::DVI,
+        instruction::MOD, instruction::MDI, instruction::AND, instruction::BOR, instruction::XOR, instruction::SHR, instruction::ASR,
+        instruction::SHL, instruction::IFB, instruction::IFC, instruction::IFE, instruction::IFN, instruction::IFG, instruction::IFA,
+        instruction::IFL, instruction::IFU, instruction::ADX, instruction::SBX, instruction::STI, instruction::STD
+    };
+    static const std::uint8_t special[] = {
+        instruction::JSR, instruction::INT, instruction::IAG, instruction::IAS, instruction::RFI, instruction::IAQ,
+        instruction::HWN, instruction::HWQ, instruction::HWI
+    };
+
+    std::mt19937 random (seed);
+    std::ostringstream name;
+    name << "random " << seed;
+
+    program p;
+    p.name = name.str();
+    p.ram.resize(0x10000);
+    for (std::size_t i = 0; i < p.ram.size(); i++) {
+        std::uint32_t kind = random() % 16;
+        std::uint16_t a = random() % 0x40;
+        if (kind < 13)
+            p.ram[i] = basic[random() % sizeof(basic)] | ((random() % 0x20) << 5) | (a << 10);
+        else if (kind < 14)
+            p.ram[i] = (special[random() % sizeof(special)] << 5) | (a << 10);
+        else
+            p.ram[i] = random();
+    }
+    return p;
+}
+
+int main(int argc, char** argv)
+{
+    optparse::OptionParser parser = optparse::OptionParser()
+        .description("Runs saturn's cpu backends side by side with libsaturn's and reports where they disagree")
+        .usage("usage: %prog [options] [binary...]");
+
+    parser.add_option("-b", "--backend")
+        .dest("backends")
+        .action("append")
+        .help("Compare this cpu backend with the reference; may be given more than once (default: every backend)");
+
+    parser.add_option("-c", "--cycles")
+        .dest("cycles")
+        .type("long")
+        .help("Number of cycles to run each program for (default: 1000000, or 20000 when fuzzing)");
+
+    parser.add_option("-i", "--interval")
+        .dest("interval")
+        .type("long")
+        .help("Compare the machines every this many cycles (default: 1024)");
+
+    parser.add_option("--replay")
+        .dest("replay")
+        .help("Feed both machines the keyboard input recorded in this log");
+
+    parser.add_option("--fuzz")
+        .dest("fuzz")
+        .type("long")
+        .help("Run this many randomly generated programs instead of binaries");
+
+    parser.add_option("--seed")
+        .dest("seed")
+        .type("long")
+        .help("The seed of the first random program (default: 1); the rest follow on from it");
+
+    parser.add_option("--sleep-devices")
+        .dest("sleep_devices")
+        .action("store_true")
+        .help("Let the candidate's idle devices go unticked, to check that libsaturn's devices don't need them");
+
+    parser.add_option("--threads")
+        .dest("threads")
+        .type("int")
+        .help("Number of threads to fuzz on (default: one per core)");
+
+    optparse::Values options = parser.parse_args(argc, argv);
+    std::vector<std::string> binaries = parser.args();
+
+    std::uint64_t fuzz = 0;
+    if (std::string(options.get("fuzz")) != "")
+        fuzz = (long)options.get("fuzz");
+
+    std::uint64_t cycles = fuzz > 0 ? 20000 : 1000000;
+    if (std::string(options.get("cycles")) != "")
+        cycles = (long)options.get("cycles");
+
+    std::uint64_t interval = 1024;
+    if (std::string(options.get("interval")) != "")
+        interval = (long)options.get("interval");
+    if (interval == 0) {
+        std::cerr << "Error: the interval must be at least one cycle" << std::endl;
+        return -1;
+    }
+
+    bool sleep = options.get("sleep_devices");
+
+    std::string log = std::string(options.get("replay"));
+    input_log check;
+    if (log != "" && !check.load(log))
+        return -1;
+
+    std::vector<cpu_backend> backends;
+    std::list<std::string> backend_names = options.all("backends");
+    for (auto it = backend_names.begin(); it != backend_names.end(); ++it) {
+        cpu_backend backend;
+        if (!parse_cpu_backend(*it, backend)) {
+            std::cerr << "Error: invalid cpu backend \"" << *it << "\"" << std::endl;
+            return -1;
+        }
+        backends.push_back(backend);
+    }
+    if (backends.empty()) {
+        backends = cpu_backends();
+        backends.erase(backends.begin());
+    }
+
+    std::atomic<std::uint64_t> runs(0);
+    std::atomic<std::uint64_t> diverged(0);
+
+    if (fuzz > 0) {
+        std::uint32_t seed = 1;
+        if (std::string(options.get("seed")) != "")
+            seed = (long)options.get("seed");
+
+        unsigned int threads = std::thread::hardware_concurrency();
+        if (std::string(options.get("threads")) != "")
+            threads = (int)options.get("threads");
+        if (threads == 0)
+            threads = 1;
+
+        // each worker takes the next seed until they've all been tried; only
+        // the programs that diverged get printed, in one piece
+        std::atomic<std::uint64_t> next(0);
+        std::mutex output;
+        std::vector<std::thread> workers;
+        for (unsigned int i = 0; i < threads; i++) {
+            workers.push_back(std::thread([&]() {
+                for (std::uint64_t n = next++; n < fuzz; n = next++) {
+                    program p = random_program(static_cast<std::uint32_t>(seed + n));
+                    for (auto backend = backends.begin(); backend != backends.end(); ++backend) {
+                        std::ostringstream out;
+                        runs++;
+                        if (!compare(p, *backend, cycles, interval, log, sleep, out)) {
+                            diverged++;
+                            std::lock_guard<std::mutex> guard (output);
+                            std::cout << out.str();
+                        }
+                    }
+                }
+            }));
+        }
+        for (std::size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+    } else {
+        std::vector<program> programs;
+        if (binaries.empty()) {
+            const std::string bench_dir = SATURN_BENCH_DIR;
+            const std::string examples_dir = SATURN_EXAMPLES_DIR;
+            const char* canned[] = { "alu_loop", "mem_copy", "int_storm", "hwi_traffic" };
+            const char* examples[] = { "test", "key", "floppy", "sped_pyramid" };
+
+            for (std::size_t i = 0; i < sizeof(canned) / sizeof(canned[0]); i++)
+                binaries.push_back(bench_dir + "/" + canned[i] + ".bin");
+            for (std::size_t i = 0; i < sizeof(examples) / sizeof(examples[0]); i++)
+                binaries.push_back(examples_dir + "/" + examples[i] + ".bin");
+        }
+
+        for (auto it = binaries.begin(); it != binaries.end(); ++it) {
+            program p;
+            std::string name = it->substr(it->find_last_of('/') + 1);
+            if (!load_program(name, *it, p))
+                return -1;
+            for (auto backend = backends.begin(); backend != backends.end(); ++backend) {
+                runs++;
+                if (!compare(p, *backend, cycles, interval, log, sleep, std::cout))
+                    diverged++;
+            }
+        }
+    }
+
+    std::cout << diverged << " of " << runs << " runs diverged" << std::endl;
+    return diverged > 0 ? 1 : 0;
+}
@@ -0,0 +1,234 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#include "emulation_thread.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+emulation_thread::emulation_thread(machine& m, keyboard_adaptor& keyboard, double speed, bool show_rate, bool raw_frames, profiler* profile, metrics* stats) : m(m), keyboard(keyboard),
+    pacer(m.cpu.clock_speed, speed), show_rate(show_rate), raw_frames(raw_frames), profile(profile),
+    stats(stats), cycles_phase(0), publish_phase(0), cycles_per_frame(0), stop_requested(false), halted(false),
+    stopped(stop_reason::budget)
+{
+    if (stats) {
+        cycles_phase = stats->add_phase("cycles");
+        publish_phase = stats->add_phase("publish");
+        cycles_per_frame = stats->add_histogram("saturn_cycles_per_frame", "DCPU cycles executed between published frames.",
+            {100, 250, 500, 1000, 1666, 2500, 5000, 10000, 25000, 100000, 1000000});
+    }
+
+    // raw LEM1802 frames and SPED-3 vertices are read from wherever the
+    // program mapped them, and LEM1802 images are only rasterised when the
+    // words they're drawn from change
+    if (!m.lems.empty() || !m.speds.empty())
+        m.watch_hwi = true;
+
+    for (std::size_t i = 0; i < m.lems.size(); i++)
+        frames.push_back(std::unique_ptr<triple_buffer<lem_frame>>(new triple_buffer<lem_frame>()));
+    last_frames.resize(m.lems.size());
+    settling.resize(m.lems.size(), 0);
+
+    for (std::size_t i = 0; i < m.speds.size(); i++)
+        speds.push_back(std::unique_ptr<triple_buffer<sped_frame>>(new triple_buffer<sped_frame>()));
+    last_speds.resize(m.speds.size());
+
+    // give the windows something to show before the first frame is published
+    publish_frames(true);
+}
+
+emulation_thread::~emulation_thread()
+{
+    stop();
+}
+
+void emulation_thread::start()
+{
+    thread = std::thread(&emulation_thread::run, this);
+}
+
+void emulation_thread::stop()
+{
+    stop_requested = true;
+    if (thread.joinable())
+        thread.join();
+    halted = true;
+}
+
+void emulation_thread::run()
+{
+    typedef std::chrono::steady_clock steady_clock;
+
+    // frames are published at roughly the rate a monitor could show them;
+    // capturing the LEM image any more often would just be wasted work
+    const steady_clock::duration frame_interval = std::chrono::microseconds(1000000 / 60);
+
+    // when unthrottled we still come up for air every so often
+    const std::uint64_t unlimited_slice = 10000;
+
+    steady_clock::time_point next_frame = steady_clock::now() + frame_interval;
+    steady_clock::time_point batch_start = steady_clock::now();
+    std::uint64_t frame_cycles = 0;
+
+    while (!stop_requested.load(std::memory_order_relaxed)) {
+        std::uint64_t cycles = pacer.unlimited() ? unlimited_slice : pacer.due();
+        std::uint64_t done = 0;
+
+        // the cycles of this batch stand for the host time since the last
+        // one, so each key event is delivered partway through, at the cycle
+        // matching when it happened; that keeps how long keys were held
+        steady_clock::time_point batch_end = steady_clock::now();
+        steady_clock::duration batch_length = batch_end - batch_start;
+
+        bool idle = false;
+        {
+            phase_timer timer (cycles_phase);
+            steady_clock::time_point when;
+            while (!is_final(stopped) && keyboard.pending(when) && when <= batch_end) {
+                std::uint64_t at = done;
+                if (when > batch_start && batch_length.count() > 0)
+                    at = std::max(done, static_cast<std::uint64_t>(cycles * ((when - batch_start).count() / static_cast<double>(batch_length.count()))));
+                stopped = run_cycles(m, profile, done, at);
+                if (!is_final(stopped)) {
+                    keyboard.deliver(m.cycles + done);
+                    m.input_arrived();
+                }
+            }
+
+            if (!is_final(stopped)) {
+                stopped = run_cycles(m, profile, done, cycles);
+                idle = stopped == stop_reason::idle;
+            }
+        }
+        if (is_final(stopped)) {
+            report_stop(std::cerr, m, stopped);
+            m.dump_registers(std::cerr);
+            m.cycles += done;
+            publish_frames(false);
+            halted = true;
+            break;
+        }
+        batch_start = batch_end;
+        pacer.executed(done);
+        m.cycles += done;
+        frame_cycles += done;
+        if (stats)
+            stats->add_cycles(done);
+
+        if (show_rate && pacer.rate_updated()) {
+            std::cerr << "Clock rate: " << static_cast<std::uint64_t>(pacer.measured_rate()) << " Hz";
+            if (!pacer.unlimited())
+                std::cerr << " (target " << static_cast<std::uint64_t>(pacer.target_rate()) << " Hz)";
+            std::cerr << std::endl;
+        }
+
+        steady_clock::time_point now = steady_clock::now();
+        if (now >= next_frame) {
+            {
+                phase_timer timer (publish_phase);
+                publish_frames(false);
+            }
+            if (cycles_per_frame)
+                cycles_per_frame->observe(frame_cycles);
+            frame_cycles = 0;
+            next_frame += frame_interval;
+            if (next_frame < now)
+                next_frame = now + frame_interval;
+        }
+
+        // an idle program went through its batch in no time; unthrottled, it
+        // would otherwise have us spinning through empty batches
+        if (!pacer.unlimited() || idle)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    std::cerr << "Average clock rate: " << static_cast<std::uint64_t>(pacer.average_rate()) << " Hz";
+    if (!pacer.unlimited())
+        std::cerr << " (target " << static_cast<std::uint64_t>(pacer.target_rate()) << " Hz)";
+    std::cerr << std::endl;
+}
+
+void emulation_thread::publish_frames(bool force)
+{
+    // how long a LEM1802 keeps rasterising after its words change, which
+    // covers it showing its start up screen for a while once connected
+    const unsigned int settle_frames = 3 * 60;
+
+    for (std::size_t i = 0; i < frames.size(); i++) {
+        lem_frame& frame = frames[i]->write_buffer();
+        lem_frame& last = last_frames[i];
+
+        // raw frames are a few hundred words, so they're sent whole whenever
+        // anything changed
+        std::uint16_t dirty;
+        if (raw_frames) {
+            frame.capture_raw(m.cpu, m.lem_mappings[i]);
+            dirty = force || frame.compare_raw(last) ? lem_frame::all_rows : 0;
+        } else {
+            // the words the image is drawn from are a tiny fraction of its
+            // pixels, so they're looked at first and an unchanged screen is
+            // never rasterised, unless something on it blinks
+            frame.capture_raw(m.cpu, m.lem_mappings[i]);
+            if (force || frame.compare_raw(last)) {
+                last.copy_words(frame);
+                settling[i] = settle_frames;
+            }
+            if (settling[i] == 0 && !frame.blinks())
+                continue;
+            if (settling[i] > 0)
+                settling[i]--;
+
+            frame.capture(*m.lems[i]);
+            dirty = force ? lem_frame::all_rows : frame.compare(last);
+        }
+
+        bool border_changed = frame.border.r != last.border.r || frame.border.g != last.border.g || frame.border.b != last.border.b;
+
+        // nothing to see here; the window keeps showing what it has
+        if (!dirty && !border_changed && !force)
+            continue;
+
+        frame.sequence = force ? 0 : last.sequence + 1;
+        frame.dirty_rows = dirty;
+        if (raw_frames)
+            last.copy_raw(frame);
+        else
+            last.copy_rows(frame, dirty);
+        last.sequence = frame.sequence;
+
+        frames[i]->publish();
+    }
+
+    // SPED-3 frames are only published when the vertices or rotation change,
+    // which is when the windows need to upload them again
+    for (std::size_t i = 0; i < speds.size(); i++) {
+        sped_frame& frame = speds[i]->write_buffer();
+        frame.capture(m.cpu, m.sped_mappings[i]);
+
+        if (!force && !frame.compare(last_speds[i]))
+            continue;
+
+        last_speds[i] = frame;
+        speds[i]->publish();
+    }
+}
@@ -0,0 +1,106 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#ifndef EMULATION_THREAD_HPP
+#define EMULATION_THREAD_HPP
+
+#include "machine.hpp"
+#include "lem_frame.hpp"
+#include "sped_frame.hpp"
+#include "triple_buffer.hpp"
+#include "keyboard_adaptor.hpp"
+#include "cycle_pacer.hpp"
+#include "profiler.hpp"
+#include "metrics.hpp"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/// runs a machine's dcpu on its own thread at the emulated clock speed (times
+/// speed, where zero means unthrottled). LEM1802 frames are published either
+/// as pixels or, with raw_frames, as the raw words for windows to rasterise
+/// on the GPU; SPED-3 frames are published as their vertex lists. once
+/// started, the machine belongs to this thread; the window thread only sees
+/// the LEM1802 frames it publishes and only feeds it through the keyboard
+/// adaptor. every cycle is counted by profile, and the time spent running
+/// cycles and publishing frames by stats, if given
+class emulation_thread {
+    public:
+        emulation_thread(machine& m, keyboard_adaptor& keyboard, double speed, bool show_rate, bool raw_frames, profiler* profile = 0, metrics* stats = 0);
+        ~emulation_thread();
+
+        void start();
+        void stop();
+
+        /// has LEM1802 frames published as pixels after all, for when the
+        /// windows can't rasterise raw ones; only before start()
+        void publish_pixels() { raw_frames = false; }
+
+        /// false once the program has crashed out or stopped itself (or
+        /// stop() was called)
+        bool running() const { return !halted.load(std::memory_order_relaxed); }
+
+        /// the process exit status for how the program ended (see
+        /// exit_status); only meaningful once stop() has been called
+        int exit_status() const { return ::exit_status(m, stopped, false); }
+
+        /// the frames published for the i'th LEM1802 of the machine
+        triple_buffer<lem_frame>& lem_frames(std::size_t i) { return *frames[i]; }
+
+        /// the frames published for the i'th SPED-3 of the machine
+        triple_buffer<sped_frame>& sped_frames(std::size_t i) { return *speds[i]; }
+    private:
+        void run();
+        void publish_frames(bool force);
+
+        machine& m;
+        keyboard_adaptor& keyboard;
+        cycle_pacer pacer;
+        bool show_rate;
+        bool raw_frames;
+        profiler* profile;
+
+        metrics* stats;
+        metrics::phase* cycles_phase;
+        metrics::phase* publish_phase;
+        metrics::histogram* cycles_per_frame;
+        std::vector<std::unique_ptr<triple_buffer<lem_frame>>> frames;
+
+        // the last frame published for each LEM1802, to find out what changed
+        std::vector<lem_frame> last_frames;
+
+        /// frames left for which each LEM1802 is rasterised whatever its raw
+        /// words, since it last had them change
+        std::vector<unsigned int> settling;
+
+        std::vector<std::unique_ptr<triple_buffer<sped_frame>>> speds;
+        std::vector<sped_frame> last_speds;
+
+        std::thread thread;
+        std::atomic<bool> stop_requested;
+        std::atomic<bool> halted;
+        stop_reason stopped;
+};
+
+#endif
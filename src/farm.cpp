@@ -0,0 +1,184 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#include "farm.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+namespace {
+    // as in headless mode, slices are long enough that the bookkeeping
+    // around them doesn't show
+    const std::uint64_t slice = 0x10000;
+}
+
+farm::farm(std::size_t threads) : threads(threads), remaining(0), queued(0), waiting(0), max_cycles(0), has_deadline(false)
+{
+    if (this->threads == 0)
+        this->threads = std::thread::hardware_concurrency();
+    if (this->threads == 0)
+        this->threads = 1;
+}
+
+void farm::add(std::unique_ptr<machine> m)
+{
+    instance in;
+    in.m = std::move(m);
+    in.cycles = 0;
+    in.stopped = stop_reason::budget;
+    in.idle = false;
+    instances.push_back(std::move(in));
+}
+
+int farm::run(std::uint64_t max_cycles, double max_seconds, bool stop_expected)
+{
+    const steady_clock::time_point start = steady_clock::now();
+    this->max_cycles = max_cycles;
+    has_deadline = max_seconds > 0;
+    deadline = start + std::chrono::duration_cast<steady_clock::duration>(std::chrono::duration<double>(max_seconds));
+
+    // no point in more workers than machines; deal the machines out evenly to begin with
+    std::size_t workers = std::min(threads, instances.size());
+    queues.clear();
+    for (std::size_t i = 0; i < workers; i++)
+        queues.push_back(std::unique_ptr<work_queue>(new work_queue()));
+    for (std::size_t i = 0; i < instances.size(); i++)
+        queues[i % workers]->work.push_back(i);
+    remaining = instances.size();
+    queued = instances.size();
+
+    std::vector<std::thread> pool;
+    for (std::size_t i = 0; i < workers; i++)
+        pool.push_back(std::thread(&farm::work, this, i));
+    for (std::size_t i = 0; i < pool.size(); i++)
+        pool[i].join();
+
+    double seconds = std::chrono::duration<double>(steady_clock::now() - start).count();
+
+    // cycles skipped through idle loops took no time, so aren't counted
+    // towards the rate
+    std::uint64_t cycles = 0;
+    std::uint64_t skipped = 0;
+    std::size_t idle = 0;
+    int status = 0;
+    for (std::size_t i = 0; i < instances.size(); i++) {
+        const instance& in = instances[i];
+        cycles += in.cycles;
+        skipped += in.m->skipped_cycles;
+        idle += in.idle;
+        if (is_final(in.stopped)) {
+            std::cerr << "Instance " << i << ": ";
+            report_stop(std::cerr, *in.m, in.stopped);
+        }
+        if (status == 0)
+            status = exit_status(*in.m, in.stopped, stop_expected);
+    }
+
+    std::uint64_t executed = cycles - skipped;
+    std::cerr << "Executed " << executed << " cycles across " << instances.size() << " instances on " << workers << " threads in " << seconds << " seconds";
+    if (seconds > 0)
+        std::cerr << " (" << static_cast<std::uint64_t>(executed / seconds) << " cycles/sec)";
+    std::cerr << std::endl;
+    if (idle > 0)
+        std::cerr << idle << " of the instances went idle, and " << skipped << " cycles were skipped through to the end" << std::endl;
+
+    return status;
+}
+
+void farm::work(std::size_t self)
+{
+    // a worker with nothing to take waits until every machine is done,
+    // since the ones other workers are running may still be requeued
+    while (remaining.load(std::memory_order_acquire) > 0) {
+        std::size_t index;
+        if (!take(self, index)) {
+            std::unique_lock<std::mutex> guard (idle_lock);
+            waiting++;
+            idle_workers.wait(guard, [this] { return remaining == 0 || queued > 0; });
+            waiting--;
+            continue;
+        }
+
+        if (run_slice(instances[index])) {
+            if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                std::lock_guard<std::mutex> guard (idle_lock);
+                idle_workers.notify_all();
+            }
+        } else {
+            {
+                std::lock_guard<std::mutex> guard (queues[self]->lock);
+                queues[self]->work.push_back(index);
+                queued++;
+            }
+            // a worker about to wait either sees the count go up or has
+            // already said it's waiting, and taking the lock makes sure it's
+            // then waiting to be woken
+            if (waiting > 0) {
+                std::lock_guard<std::mutex> guard (idle_lock);
+                idle_workers.notify_one();
+            }
+        }
+    }
+}
+
+bool farm::take(std::size_t self, std::size_t& index)
+{
+    // our own queue is worked from the front, round robin, and others' are
+    // stolen from the back, so a thief takes what the owner would get to last
+    for (std::size_t i = 0; i < queues.size(); i++) {
+        work_queue& queue = *queues[(self + i) % queues.size()];
+        std::lock_guard<std::mutex> guard (queue.lock);
+        if (queue.work.empty())
+            continue;
+        if (i == 0) {
+            index = queue.work.front();
+            queue.work.pop_front();
+        } else {
+            index = queue.work.back();
+            queue.work.pop_back();
+        }
+        queued--;
+        return true;
+    }
+    return false;
+}
+
+bool farm::run_slice(instance& in)
+{
+    // nothing can wake an idle machine here, since a farm gives them no input
+    std::uint64_t todo = slice;
+    if (max_cycles != 0 && (in.idle || max_cycles - in.cycles < todo))
+        todo = max_cycles - in.cycles;
+
+    std::uint64_t done = 0;
+    while (done < todo && !is_final(in.stopped)) {
+        run_result result = in.m->run(todo - done);
+        done += result.cycles;
+        in.stopped = result.reason;
+        in.idle = result.reason == stop_reason::idle;
+    }
+    in.cycles += done;
+    in.m->cycles += done;
+
+    return is_final(in.stopped) || (in.idle && max_cycles == 0) || (max_cycles != 0 && in.cycles >= max_cycles) || (has_deadline && steady_clock::now() >= deadline);
+}
@@ -0,0 +1,101 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#ifndef FARM_HPP
+#define FARM_HPP
+
+#include "machine.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/// runs many independent machines headlessly at once, on a pool of worker
+/// threads (as many as the host has cores, unless told otherwise). each
+/// machine is run a slice at a time; a worker takes machines from its own
+/// queue and steals from the others' once that runs dry, so the load stays
+/// balanced as machines finish at different times
+class farm {
+    public:
+        farm(std::size_t threads = 0);
+
+        /// adds a machine, already loaded with its program; the farm owns it
+        /// from then on
+        void add(std::unique_ptr<machine> m);
+
+        std::size_t size() const { return instances.size(); }
+        machine& at(std::size_t i) { return *instances[i].m; }
+
+        /// runs every machine until it hits an invalid opcode, a breakpoint or
+        /// watchpoint or the halt HWI, has executed max_cycles cycles or
+        /// max_seconds of wall-clock time have passed (a limit of zero means
+        /// no limit). an idle machine is skipped straight to max_cycles, or
+        /// finishes there and then if there's no cycle limit. prints the
+        /// aggregate clock rate and how each machine that stopped itself ended
+        /// to stderr, and returns the first nonzero exit status of the
+        /// machines (see exit_status)
+        int run(std::uint64_t max_cycles, double max_seconds, bool stop_expected = false);
+    private:
+        typedef std::chrono::steady_clock steady_clock;
+
+        struct instance {
+            std::unique_ptr<machine> m;
+            std::uint64_t cycles;
+            stop_reason stopped;
+            /// the program went idle, and with no input to come it'll stay so
+            bool idle;
+        };
+
+        struct work_queue {
+            std::mutex lock;
+            std::deque<std::size_t> work;
+        };
+
+        void work(std::size_t self);
+        bool take(std::size_t self, std::size_t& index);
+
+        /// runs one slice of an instance; returns true once it's finished
+        bool run_slice(instance& in);
+
+        std::size_t threads;
+        std::vector<instance> instances;
+        std::vector<std::unique_ptr<work_queue>> queues;
+        std::atomic<std::size_t> remaining;
+
+        /// machines sitting in a queue; workers with nothing to take wait on
+        /// idle_workers until there are some, or none remain
+        std::atomic<std::size_t> queued;
+        std::atomic<std::size_t> waiting;
+        std::mutex idle_lock;
+        std::condition_variable idle_workers;
+
+        std::uint64_t max_cycles;
+        bool has_deadline;
+        steady_clock::time_point deadline;
+};
+
+#endif
@@ -0,0 +1,470 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#include "gdb_stub.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+    const char* digits = "0123456789abcdef";
+
+    std::string hex_byte(std::uint8_t value)
+    {
+        return std::string(1, digits[value >> 4]) + digits[value & 0xf];
+    }
+
+    std::string hex_word(std::uint16_t value)
+    {
+        return hex_byte(value >> 8) + hex_byte(value & 0xff);
+    }
+
+    std::string hex_number(std::uint32_t value)
+    {
+        std::ostringstream out;
+        out << std::hex << value;
+        return out.str();
+    }
+
+    /// the number in text up to the first of stop (or the end); false if it
+    /// isn't hex or there's nothing there
+    bool parse_hex(const std::string& text, std::size_t& at, char stop, std::uint32_t& value)
+    {
+        std::size_t end = text.find(stop, at);
+        if (end == std::string::npos)
+            end = text.size();
+        if (end == at || end - at > 8)
+            return false;
+
+        value = 0;
+        for (; at < end; at++) {
+            const char* digit = std::strchr(digits, std::tolower(text[at]));
+            if (!digit || *digit == '\0')
+                return false;
+            value = (value << 4) | static_cast<std::uint32_t>(digit - digits);
+        }
+        if (at < text.size())
+            at++;
+        return true;
+    }
+
+    // the registers in the order the debugger sees them
+    const std::size_t register_count = 12;
+
+    std::uint16_t& register_ref(galaxy::saturn::dcpu& cpu, std::size_t index)
+    {
+        switch (index) {
+            case 8: return cpu.PC;
+            case 9: return cpu.SP;
+            case 10: return cpu.EX;
+            case 11: return cpu.IA;
+        }
+        return register_at(cpu, static_cast<std::uint8_t>(index));
+    }
+}
+
+gdb_stub::gdb_stub(machine& m) : m(m), listen_fd(-1), client(-1), acknowledge(true), stopped(stop_reason::breakpoint), stop_reply("S05")
+{
+}
+
+gdb_stub::~gdb_stub()
+{
+    if (client >= 0)
+        close(client);
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        if (socket_path != "")
+            unlink(socket_path.c_str());
+    }
+}
+
+bool gdb_stub::listen(const std::string& address)
+{
+    if (address.compare(0, 5, "unix:") == 0) {
+        std::string path = address.substr(5);
+        sockaddr_un local;
+        std::memset(&local, 0, sizeof(local));
+        local.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(local.sun_path)) {
+            std::cerr << "Error: invalid socket path \"" << path << "\"" << std::endl;
+            return false;
+        }
+        std::strcpy(local.sun_path, path.c_str());
+
+        listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0) {
+            std::cerr << "Error: could not create socket: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+
+        // a socket left behind by an earlier run would stop us binding
+        unlink(path.c_str());
+        if (bind(listen_fd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0 || ::listen(listen_fd, 1) != 0) {
+            std::cerr << "Error: could not listen on \"" << path << "\": " << std::strerror(errno) << std::endl;
+            close(listen_fd);
+            listen_fd = -1;
+            return false;
+        }
+        socket_path = path;
+        return true;
+    }
+
+    char* end = 0;
+    unsigned long port = std::strtoul(address.c_str(), &end, 10);
+    if (address.empty() || *end != '\0' || port > 0xffff) {
+        std::cerr << "Error: invalid debugger address \"" << address << "\"" << std::endl;
+        return false;
+    }
+
+    sockaddr_in local;
+    std::memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_port = htons(static_cast<std::uint16_t>(port));
+    local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        std::cerr << "Error: could not create socket: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    int on = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (bind(listen_fd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0 || ::listen(listen_fd, 1) != 0) {
+        std::cerr << "Error: could not listen on port " << port << ": " << std::strerror(errno) << std::endl;
+        close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+    return true;
+}
+
+int gdb_stub::run()
+{
+    std::cerr << "Waiting for a debugger to connect" << std::endl;
+    client = accept(listen_fd, 0, 0);
+    if (client < 0) {
+        std::cerr << "Error: could not accept a debugger: " << std::strerror(errno) << std::endl;
+        return -1;
+    }
+
+    // every packet is a round trip, so don't hold any back
+    if (socket_path == "") {
+        int on = 1;
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+
+    std::string packet;
+    bool done = false;
+    while (!done && receive(packet)) {
+        // a kill gets no reply
+        if (packet == "k")
+            break;
+        if (!send(handle(packet, done)))
+            break;
+    }
+
+    close(client);
+    client = -1;
+    return exit_status(m, stopped, false);
+}
+
+bool gdb_stub::receive(std::string& packet)
+{
+    for (;;) {
+        // anything outside a packet is an acknowledgement, which we don't
+        // need, or an interrupt with nothing running
+        std::size_t start = pending.find('$');
+        if (start == std::string::npos)
+            pending.clear();
+        else
+            pending.erase(0, start);
+
+        std::size_t hash = pending.find('#');
+        if (hash != std::string::npos && pending.size() >= hash + 3) {
+            packet = pending.substr(1, hash - 1);
+            std::string checksum = pending.substr(hash + 1, 2);
+            pending.erase(0, hash + 3);
+
+            std::uint8_t sum = 0;
+            for (std::size_t i = 0; i < packet.size(); i++)
+                sum += static_cast<std::uint8_t>(packet[i]);
+            bool good = checksum == hex_byte(sum);
+            if (acknowledge && ::send(client, good ? "+" : "-", 1, MSG_NOSIGNAL) != 1)
+                return false;
+            if (good)
+                return true;
+            continue;
+        }
+
+        char buffer[4096];
+        ssize_t n = recv(client, buffer, sizeof(buffer), 0);
+        if (n <= 0)
+            return false;
+        pending.append(buffer, n);
+    }
+}
+
+bool gdb_stub::send(const std::string& packet)
+{
+    std::uint8_t sum = 0;
+    for (std::size_t i = 0; i < packet.size(); i++)
+        sum += static_cast<std::uint8_t>(packet[i]);
+    std::string text = "$" + packet + "#" + hex_byte(sum);
+
+    for (std::size_t sent = 0; sent < text.size(); ) {
+        ssize_t n = ::send(client, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+std::string gdb_stub::handle(const std::string& packet, bool& done)
+{
+    std::size_t at = 1;
+    std::uint32_t address, length, value;
+
+    switch (packet.empty() ? '\0' : packet[0]) {
+        case '?':
+            return stop_reply;
+        case 'g':
+            return read_registers();
+        case 'G':
+            return write_registers(packet.substr(1)) ? "OK" : "E01";
+        case 'p':
+            if (!parse_hex(packet, at, '\0', value) || value >= register_count)
+                return "E01";
+            return hex_word(register_ref(m.cpu, value));
+        case 'P':
+            if (!parse_hex(packet, at, '=', address) || address >= register_count || !parse_hex(packet, at, '\0', value))
+                return "E01";
+            register_ref(m.cpu, address) = static_cast<std::uint16_t>(value);
+            m.input_arrived();
+            return "OK";
+        case 'm':
+            if (!parse_hex(packet, at, ',', address) || !parse_hex(packet, at, '\0', length))
+                return "E01";
+            return read_memory(address, length);
+        case 'M':
+            if (!parse_hex(packet, at, ',', address) || !parse_hex(packet, at, ':', length))
+                return "E01";
+            return write_memory(address, length, packet.substr(at)) ? "OK" : "E01";
+        case 'c':
+        case 's':
+            // resuming somewhere else
+            if (packet.size() > 1) {
+                if (!parse_hex(packet, at, '\0', address))
+                    return "E01";
+                m.cpu.PC = static_cast<std::uint16_t>(address / 2);
+            }
+            stop_reply = resume(packet[0] == 's');
+            done = stop_reply[0] == 'W';
+            return stop_reply;
+        case 'Z':
+        case 'z': {
+            // software and hardware breakpoints are the same thing here, and
+            // only writes can be watched
+            bool set = packet[0] == 'Z';
+            std::uint32_t type;
+            if (!parse_hex(packet, at, ',', type) || !parse_hex(packet, at, ',', address) || !parse_hex(packet, at, '\0', length))
+                return "E01";
+            if (address >= 0x20000)
+                return "E01";
+            if (type == 0 || type == 1) {
+                m.set_breakpoint(static_cast<std::uint16_t>(address / 2), set);
+                return "OK";
+            }
+            if (type == 2) {
+                for (std::uint32_t word = address / 2; word <= (address + std::max<std::uint32_t>(length, 1) - 1) / 2 && word < 0x10000; word++)
+                    m.set_watchpoint(static_cast<std::uint16_t>(word), set);
+                return "OK";
+            }
+            return "";
+        }
+        case 'D':
+            done = true;
+            return "OK";
+        case 'H':
+        case 'T':
+            // there's only the one thread
+            return "OK";
+        case 'q':
+            if (packet.compare(0, 10, "qSupported") == 0)
+                return "PacketSize=4000;QStartNoAckMode+";
+            if (packet == "qAttached")
+                return "1";
+            if (packet == "qC")
+                return "QC1";
+            if (packet == "qfThreadInfo")
+                return "m1";
+            if (packet == "qsThreadInfo")
+                return "l";
+            return "";
+        case 'Q':
+            if (packet == "QStartNoAckMode") {
+                acknowledge = false;
+                return "OK";
+            }
+            return "";
+    }
+
+    // an empty reply tells the debugger the packet isn't supported
+    return "";
+}
+
+std::string gdb_stub::resume(bool step)
+{
+    // looking for an interrupt from the debugger is far more expensive than
+    // a cycle, so when continuing we only do it once per slice
+    const std::uint64_t slice = 0x10000;
+    std::uint64_t unchecked = 0;
+
+    for (;;) {
+        run_result result = m.run(step ? 1 : slice - unchecked);
+        m.cycles += result.cycles;
+        unchecked += result.cycles;
+        stopped = result.reason;
+
+        switch (result.reason) {
+            case stop_reason::breakpoint:
+                return "S05";
+            case stop_reason::watchpoint:
+                return "T05watch:" + hex_number(result.address * 2u) + ";";
+            case stop_reason::invalid_opcode:
+                return "S04";
+            case stop_reason::halt:
+                return "W" + hex_byte(m.cpu.A & 0xff);
+            default:
+                break;
+        }
+
+        if (step && result.cycles > 0)
+            return "S05";
+
+        // an idle program has nothing to do until the debugger says so, so
+        // wait on it rather than spin
+        bool idle = result.reason == stop_reason::idle;
+        if (idle || unchecked >= slice) {
+            unchecked = 0;
+            if (interrupted(idle ? 1 : 0))
+                return "S02";
+        }
+    }
+}
+
+bool gdb_stub::interrupted(int timeout)
+{
+    pollfd waiting = { client, POLLIN, 0 };
+    if (poll(&waiting, 1, timeout) <= 0)
+        return false;
+
+    // the connection going counts as an interrupt too, so we stop running
+    char buffer[4096];
+    ssize_t n = recv(client, buffer, sizeof(buffer), 0);
+    if (n <= 0)
+        return true;
+    pending.append(buffer, n);
+
+    std::size_t ctrl_c = pending.find('\x03');
+    if (ctrl_c == std::string::npos)
+        return false;
+    pending.erase(ctrl_c, 1);
+    return true;
+}
+
+std::string gdb_stub::read_registers() const
+{
+    std::string hex;
+    for (std::size_t i = 0; i < register_count; i++)
+        hex += hex_word(register_ref(m.cpu, i));
+    return hex;
+}
+
+bool gdb_stub::write_registers(const std::string& hex)
+{
+    if (hex.size() < register_count * 4)
+        return false;
+
+    std::uint16_t values[register_count];
+    for (std::size_t i = 0; i < register_count; i++) {
+        std::size_t at = i * 4;
+        std::uint32_t value;
+        if (!parse_hex(hex.substr(0, at + 4), at, '\0', value))
+            return false;
+        values[i] = static_cast<std::uint16_t>(value);
+    }
+    for (std::size_t i = 0; i < register_count; i++)
+        register_ref(m.cpu, i) = values[i];
+    m.input_arrived();
+    return true;
+}
+
+std::string gdb_stub::read_memory(std::uint32_t address, std::uint32_t length) const
+{
+    // a read running off the end of memory gets what there is
+    if (address >= 0x20000)
+        return "E01";
+    length = std::min(length, 0x20000 - address);
+
+    std::string hex;
+    for (std::uint32_t byte = address; byte < address + length; byte++) {
+        std::uint16_t word = m.cpu.ram[byte / 2];
+        hex += hex_byte(byte % 2 ? word & 0xff : word >> 8);
+    }
+    return hex;
+}
+
+bool gdb_stub::write_memory(std::uint32_t address, std::uint32_t length, const std::string& hex)
+{
+    if (address >= 0x20000 || length > 0x20000 - address || hex.size() != length * 2)
+        return false;
+
+    for (std::uint32_t i = 0; i < length; i++) {
+        std::size_t at = i * 2;
+        std::uint32_t value;
+        if (!parse_hex(hex.substr(0, at + 2), at, '\0', value))
+            return false;
+
+        std::uint16_t& word = m.cpu.ram[(address + i) / 2];
+        if ((address + i) % 2)
+            word = static_cast<std::uint16_t>((word & 0xff00) | value);
+        else
+            word = static_cast<std::uint16_t>((word & 0x00ff) | (value << 8));
+    }
+    m.input_arrived();
+    return true;
+}
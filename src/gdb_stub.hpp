@@ -0,0 +1,88 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#ifndef GDB_STUB_HPP
+#define GDB_STUB_HPP
+
+#include "machine.hpp"
+
+#include <cstdint>
+#include <string>
+
+/// lets GDB (or anything else speaking its remote serial protocol) debug the
+/// program running on a machine: read and write the registers and memory,
+/// set breakpoints and write watchpoints, step and continue. memory is seen as
+/// bytes, each word big-endian at twice its address, and the registers as
+/// A, B, C, X, Y, Z, I, J, PC, SP, EX and IA, sixteen bits each and also
+/// big-endian. the program only runs while the debugger has told it to, and
+/// breakpoints and watchpoints are the machine's own, so with none set it
+/// runs exactly as fast as it would without a debugger
+class gdb_stub {
+    public:
+        gdb_stub(machine& m);
+        ~gdb_stub();
+
+        /// listens on a TCP port on localhost, or on a UNIX socket given as
+        /// unix:PATH. returns false (having printed why) if it can't
+        bool listen(const std::string& address);
+
+        /// waits for a debugger to connect, then serves it until it detaches
+        /// or kills the program, the connection drops or the program halts
+        /// itself. returns the process exit status (see exit_status)
+        int run();
+    private:
+        /// reads the next packet, acknowledging it; false if the connection
+        /// has gone
+        bool receive(std::string& packet);
+        bool send(const std::string& packet);
+
+        /// the reply to a packet, and whether that ends the session
+        std::string handle(const std::string& packet, bool& done);
+
+        /// runs the program, one instruction or until it stops, and returns
+        /// the stop reply; an interrupt (^C) from the debugger stops it too
+        std::string resume(bool step);
+
+        /// whether the debugger has sent an interrupt, waiting up to timeout
+        /// milliseconds for one
+        bool interrupted(int timeout);
+
+        std::string read_registers() const;
+        bool write_registers(const std::string& hex);
+        std::string read_memory(std::uint32_t address, std::uint32_t length) const;
+        bool write_memory(std::uint32_t address, std::uint32_t length, const std::string& hex);
+
+        machine& m;
+        int listen_fd;
+        int client;
+        std::string socket_path;
+
+        /// what's been received but not yet handled
+        std::string pending;
+        bool acknowledge;
+
+        /// why the program last stopped, and the reply that said so
+        stop_reason stopped;
+        std::string stop_reply;
+};
+
+#endif
@@ -0,0 +1,121 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#include "headless.hpp"
+#include "cycle_pacer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+int run_headless(machine& m, std::uint64_t max_cycles, double max_seconds, double speed, input_log* replay, profiler* profile,
+    bool stop_expected)
+{
+    typedef std::chrono::steady_clock steady_clock;
+
+    // reading the host clock is far more expensive than a cycle, so we only
+    // look at it once per slice
+    const std::uint64_t slice = 0x10000;
+
+    const steady_clock::time_point start = steady_clock::now();
+    const steady_clock::time_point deadline = start + std::chrono::duration_cast<steady_clock::duration>(std::chrono::duration<double>(max_seconds));
+
+    cycle_pacer pacer(m.cpu.clock_speed, speed);
+
+    std::uint64_t cycles = 0;
+    const std::uint64_t skipped_before = m.skipped_cycles;
+
+    stop_reason stopped = stop_reason::budget;
+    bool idle = false;
+    while (!is_final(stopped) && (max_cycles == 0 || cycles < max_cycles)) {
+        std::uint64_t todo = pacer.unlimited() ? slice : pacer.due();
+        std::uint64_t due;
+
+        // unthrottled, an idle program is skipped straight to its next replayed
+        // event or the cycle limit. with neither, nothing can ever wake it, so
+        // we either wait out the time limit or stop here
+        if (idle && pacer.unlimited()) {
+            if (replay && replay->next(due))
+                todo = std::max(todo, due - m.cycles - cycles);
+            else if (max_cycles != 0)
+                todo = max_cycles - cycles;
+            else if (max_seconds > 0) {
+                std::this_thread::sleep_until(deadline);
+                break;
+            } else {
+                std::cerr << "Program is idle with no input left to give it; stopping" << std::endl;
+                break;
+            }
+        }
+        if (max_cycles != 0 && max_cycles - cycles < todo)
+            todo = max_cycles - cycles;
+
+        // the slice is cut short at each replayed event, which goes in just
+        // before the cycle it was recorded at
+        std::uint64_t end = cycles + todo;
+        while (!is_final(stopped) && replay && replay->next(due) && due < m.cycles + end) {
+            if (due > m.cycles)
+                stopped = run_cycles(m, profile, cycles, due - m.cycles);
+            if (!is_final(stopped)) {
+                replay->replay(*m.keyboard);
+                m.input_arrived();
+            }
+        }
+        if (!is_final(stopped)) {
+            stopped = run_cycles(m, profile, cycles, end);
+            idle = stopped == stop_reason::idle;
+        }
+        pacer.executed(todo);
+
+        if (max_seconds > 0 && steady_clock::now() >= deadline)
+            break;
+
+        if (!pacer.unlimited())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    report_stop(std::cerr, m, stopped);
+    if (stop_expected && !is_final(stopped))
+        std::cerr << "Error: ran out of cycles or time before reaching an exit condition" << std::endl;
+    int status = exit_status(m, stopped, stop_expected);
+    m.dump_registers(std::cerr);
+
+    m.cycles += cycles;
+
+    // cycles skipped through idle loops took no time, so they'd only inflate
+    // the rate
+    std::uint64_t skipped = m.skipped_cycles - skipped_before;
+    std::uint64_t executed = cycles - skipped;
+
+    double seconds = std::chrono::duration<double>(steady_clock::now() - start).count();
+    std::cerr << "Executed " << executed << " cycles in " << seconds << " seconds";
+    if (seconds > 0)
+        std::cerr << " (" << static_cast<std::uint64_t>(executed / seconds) << " cycles/sec)";
+    if (!pacer.unlimited())
+        std::cerr << ", target " << static_cast<std::uint64_t>(pacer.target_rate()) << " cycles/sec";
+    std::cerr << std::endl;
+    if (skipped > 0)
+        std::cerr << "Skipped " << skipped << " cycles of idle loops" << std::endl;
+
+    return status;
+}
@@ -0,0 +1,44 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#ifndef HEADLESS_HPP
+#define HEADLESS_HPP
+
+#include "machine.hpp"
+#include "input_log.hpp"
+#include "profiler.hpp"
+
+#include <cstdint>
+
+/// runs the machine without any windows, until the program hits an invalid
+/// opcode, a breakpoint or watchpoint or the halt HWI, max_cycles cycles have
+/// been executed or max_seconds of wall-clock time have passed (a limit of
+/// zero means no limit). the clock is paced to speed times the dcpu's clock
+/// speed, or runs as fast as the host allows when speed is zero. keyboard
+/// events from replay, if given, are delivered at the cycles they were
+/// recorded at, and every cycle is counted by profile, if given. prints why it
+/// stopped, the registers and the achieved clock rate to stderr and returns
+/// the process exit code (see exit_status)
+int run_headless(machine& m, std::uint64_t max_cycles, double max_seconds, double speed, input_log* replay = 0, profiler* profile = 0,
+    bool stop_expected = false);
+
+#endif
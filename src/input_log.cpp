@@ -0,0 +1,97 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#include "input_log.hpp"
+
+#include <iostream>
+#include <sstream>
+
+bool input_log::create(const std::string& filename)
+{
+    out.open(filename, std::ios::out | std::ios::trunc);
+    if (!out.is_open()) {
+        std::cerr << "Error: could not open file \"" << filename << "\"" << std::endl;
+        return false;
+    }
+    out << "# saturn input log: cycle, press or release, key code" << std::endl;
+    return true;
+}
+
+bool input_log::load(const std::string& filename)
+{
+    std::ifstream in(filename);
+    if (!in.is_open()) {
+        std::cerr << "Error: could not open file \"" << filename << "\"" << std::endl;
+        return false;
+    }
+
+    events.clear();
+    position = 0;
+
+    std::string line;
+    for (int number = 1; std::getline(in, line); number++) {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::istringstream fields(line);
+        event e;
+        std::string action;
+        unsigned int code;
+        fields >> e.cycle >> action >> std::hex >> code;
+        if (fields.fail() || (action != "press" && action != "release") || code > 0xffff) {
+            std::cerr << "Error: \"" << filename << "\" line " << number << " is not an input event" << std::endl;
+            return false;
+        }
+        e.pressed = action == "press";
+        e.code = code;
+
+        // events are replayed in order, so a log must never go back in time
+        if (!events.empty() && e.cycle < events.back().cycle) {
+            std::cerr << "Error: \"" << filename << "\" line " << number << " is out of order" << std::endl;
+            return false;
+        }
+        events.push_back(e);
+    }
+    return true;
+}
+
+void input_log::record(std::uint64_t cycle, bool pressed, std::uint16_t code)
+{
+    out << cycle << (pressed ? " press 0x" : " release 0x") << std::hex << code << std::dec << "\n";
+}
+
+bool input_log::next(std::uint64_t& cycle) const
+{
+    if (position >= events.size())
+        return false;
+    cycle = events[position].cycle;
+    return true;
+}
+
+void input_log::replay(galaxy::saturn::keyboard& keyboard)
+{
+    const event& e = events[position++];
+    if (e.pressed)
+        keyboard.press(e.code);
+    else
+        keyboard.release(e.code);
+}
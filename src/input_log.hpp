@@ -0,0 +1,66 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#ifndef INPUT_LOG_HPP
+#define INPUT_LOG_HPP
+
+#include <libsaturn.hpp>
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/// keyboard events stamped with the emulated cycle they reached the keyboard
+/// at, so that a session can be replayed exactly. the log is plain text, one
+/// event per line: the cycle, "press" or "release", and the DCPU key code.
+/// a log is either recorded into or replayed from, never both
+class input_log {
+    public:
+        struct event {
+            std::uint64_t cycle;
+            bool pressed;
+            std::uint16_t code;
+        };
+
+        input_log() : position(0) {}
+
+        /// both print what went wrong and return false on failure
+        bool create(const std::string& filename);
+        bool load(const std::string& filename);
+
+        /// appends an event to a log made with create()
+        void record(std::uint64_t cycle, bool pressed, std::uint16_t code);
+
+        /// the cycle the next event of a loaded log is due at; false once
+        /// they've all been replayed
+        bool next(std::uint64_t& cycle) const;
+
+        /// hands the next event of a loaded log to the keyboard
+        void replay(galaxy::saturn::keyboard& keyboard);
+    private:
+        std::ofstream out;
+        std::vector<event> events;
+        std::size_t position;
+};
+
+#endif
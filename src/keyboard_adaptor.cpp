@@ -22,22 +22,83 @@ file named "LICENSE.txt".
 
 #include "keyboard_adaptor.hpp"
 
+// std::chrono::milliseconds takes it by reference
+const int keyboard_adaptor::type_hold_ms;
+
 void keyboard_adaptor::key_press(sf::Event::KeyEvent event)
 {
-    keyboard.press(event_to_dcpu(event));
+    post(steady_clock::now(), true, false, event_to_dcpu(event));
 }
 
 void keyboard_adaptor::key_release(sf::Event::KeyEvent event)
 {
-    keyboard.release(event_to_dcpu(event));
+    post(steady_clock::now(), false, false, event_to_dcpu(event));
 }
 
 void keyboard_adaptor::key_type(sf::Event::TextEvent event)
 {
-    if (event.unicode < 0x7f && event.unicode >= 0x20) {
-        keyboard.press(event.unicode);
-        keyboard.release(event.unicode);
+    // only the press is queued; the emulation thread lets go of the key
+    // itself, once it's been held long enough for a program polling the key
+    // state to see it
+    if (event.unicode < 0x7f && event.unicode >= 0x20)
+        post(steady_clock::now(), true, true, event.unicode);
+}
+
+const keyboard_adaptor::key_event* keyboard_adaptor::next() const
+{
+    // the releases are due in the order their presses were, so the earliest
+    // of the two queues' fronts is the next event; a release goes first on
+    // a tie, so the same character typed again is pressed after it
+    const key_event* event = events.front();
+    const key_event* release = releases.front();
+    if (!event || (release && release->when <= event->when))
+        return release;
+    return event;
+}
+
+bool keyboard_adaptor::pending(steady_clock::time_point& when) const
+{
+    const key_event* event = next();
+    if (!event)
+        return false;
+    when = event->when;
+    return true;
+}
+
+void keyboard_adaptor::deliver(std::uint64_t cycle)
+{
+    const key_event* event = next();
+    bool from_releases = event == releases.front();
+    if (recording)
+        recording->record(cycle, event->pressed, event->code);
+    if (event->pressed)
+        keyboard.press(event->code);
+    else
+        keyboard.release(event->code);
+
+    // a typed key's release is due type_hold_ms after the press, in host time
+    // as everything else is; with that many keys already held, it's let go of
+    // straight away rather than left stuck
+    if (event->typed) {
+        key_event release = {event->when + std::chrono::milliseconds(type_hold_ms), false, false, event->code};
+        if (!releases.push(release)) {
+            if (recording)
+                recording->record(cycle, false, event->code);
+            keyboard.release(event->code);
+        }
     }
+
+    if (from_releases)
+        releases.pop();
+    else
+        events.pop();
+}
+
+void keyboard_adaptor::post(steady_clock::time_point when, bool pressed, bool typed, std::uint16_t code)
+{
+    // a full queue means the emulation thread isn't keeping up at all; losing
+    // keys is better than stalling the windows
+    events.push(key_event{when, pressed, typed, code});
 }
 
 std::uint16_t keyboard_adaptor::event_to_dcpu(sf::Event::KeyEvent key)
@@ -20,20 +20,75 @@ file named "LICENSE.txt".
 
 */
 
+#ifndef KEYBOARD_ADAPTOR_HPP
+#define KEYBOARD_ADAPTOR_HPP
+
 #include <libsaturn.hpp>
 
+#include "spsc_queue.hpp"
+#include "input_log.hpp"
+
 #include <SFML/Window.hpp>
 
+#include <chrono>
+#include <cstdint>
+
+/// key events arrive on the window thread, but the keyboard belongs to the
+/// emulation thread; they are stamped with the host time they happened at and
+/// queued here (without locking) until the emulation thread reaches that
+/// moment in emulated time and delivers them. the releases of typed keys are
+/// queued separately, by the emulation thread, as their presses are delivered
 class keyboard_adaptor {
     public:
-        keyboard_adaptor(galaxy::saturn::keyboard& keyboard) : keyboard(keyboard) {}
+        typedef std::chrono::steady_clock steady_clock;
+
+        /// how long a typed character is held down for, since text events
+        /// don't say when the key came back up
+        static const int type_hold_ms = 20;
+
+        keyboard_adaptor(galaxy::saturn::keyboard& keyboard) : keyboard(keyboard), recording(0) {}
+
+        /// logs every event delivered from now on; set before the emulation
+        /// thread starts
+        void record_to(input_log* log) { recording = log; }
+
+        /// window thread side
         void key_press(sf::Event::KeyEvent event);
         void key_release(sf::Event::KeyEvent event);
-
-        /// this function instantaneously presses and releases the key; try to improve this if possible
         void key_type(sf::Event::TextEvent event);
+
+        /// emulation thread side: the host time the next event is due at,
+        /// or false if there are none
+        bool pending(steady_clock::time_point& when) const;
+
+        /// emulation thread side: hands the next event to the keyboard at the
+        /// given emulated cycle; only call after pending() found one
+        void deliver(std::uint64_t cycle);
     private:
+        struct key_event {
+            steady_clock::time_point when;
+            bool pressed;
+            /// a typed key, which the emulation thread releases by itself
+            bool typed;
+            std::uint16_t code;
+        };
+
         // returns a DCPU key code if valid, 0 otherwise
         std::uint16_t event_to_dcpu(sf::Event::KeyEvent event);
+        void post(steady_clock::time_point when, bool pressed, bool typed, std::uint16_t code);
+
+        /// whichever of events and releases has the earlier front, or null
+        const key_event* next() const;
+
         galaxy::saturn::keyboard& keyboard;
+        input_log* recording;
+
+        // several seconds of furious typing; events beyond that are dropped
+        spsc_queue<key_event, 256> events;
+
+        // releases of typed keys that have been pressed, due in order; only
+        // the emulation thread touches these
+        spsc_queue<key_event, 256> releases;
 };
+
+#endif
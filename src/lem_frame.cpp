@@ -0,0 +1,172 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#include "lem_frame.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <list>
+
+namespace {
+    /// the LEM1802's built in font and palette. libsaturn keeps them to itself,
+    /// but a LEM1802 will dump them into memory when asked, so we ask one
+    struct lem_defaults {
+        lem_defaults()
+        {
+            machine scratch(1, 0, std::list<std::string>());
+
+            const std::uint16_t font_address = 0x1000;
+            const std::uint16_t palette_address = 0x1100;
+            const std::uint16_t program[] = {
+                0x9401,                     // SET A, 4 (MEM_DUMP_FONT)
+                0x7c21, font_address,       // SET B, font_address
+                0x8640,                     // HWI 0
+                0x9801,                     // SET A, 5 (MEM_DUMP_PALETTE)
+                0x7c21, palette_address,    // SET B, palette_address
+                0x8640,                     // HWI 0
+                0xa781,                     // end: SET PC, end
+            };
+            scratch.cpu.flash(program, program + sizeof(program) / sizeof(program[0]));
+
+            // the dumps take a cycle per word, so this is plenty
+            for (int i = 0; i < 1000; i++)
+                scratch.cpu.cycle();
+
+            std::copy(scratch.cpu.ram.begin() + font_address, scratch.cpu.ram.begin() + font_address + font.size(), font.begin());
+            std::copy(scratch.cpu.ram.begin() + palette_address, scratch.cpu.ram.begin() + palette_address + palette.size(), palette.begin());
+        }
+
+        std::array<std::uint16_t, lem_frame::font_words> font;
+        std::array<std::uint16_t, lem_frame::palette_words> palette;
+    };
+
+    const lem_defaults& defaults()
+    {
+        static const lem_defaults instance;
+        return instance;
+    }
+}
+
+void lem_frame::capture(const galaxy::saturn::lem1802& lem)
+{
+    // libsaturn hands the image back by value; convert straight out of that
+    // temporary rather than copying it anywhere else first
+    const std::array<std::array<galaxy::saturn::color, width>, height>& image = lem.image();
+
+    std::uint32_t* out = pixels.data();
+    for (unsigned int y = 0; y < height; y++) {
+        const galaxy::saturn::color* row = image[y].data();
+        // a flat loop of independent pixels, which the compiler can vectorise
+        for (unsigned int x = 0; x < width; x++) {
+            const std::uint8_t rgba[4] = { row[x].r, row[x].g, row[x].b, 255 };
+            std::memcpy(out + x, rgba, sizeof(rgba));
+        }
+        out += width;
+    }
+
+    border = lem.border();
+}
+
+std::uint16_t lem_frame::compare(const lem_frame& other) const
+{
+    const std::size_t row_pixels = width * cell_height;
+
+    std::uint16_t mask = 0;
+    for (unsigned int row = 0; row < cell_rows; row++) {
+        if (std::memcmp(pixels.data() + row * row_pixels, other.pixels.data() + row * row_pixels, row_pixels * sizeof(std::uint32_t)) != 0)
+            mask |= 1 << row;
+    }
+    return mask;
+}
+
+void lem_frame::copy_rows(const lem_frame& other, std::uint16_t mask)
+{
+    const std::size_t row_pixels = width * cell_height;
+
+    for (unsigned int row = 0; row < cell_rows; row++) {
+        if (mask & (1 << row))
+            std::memcpy(pixels.data() + row * row_pixels, other.pixels.data() + row * row_pixels, row_pixels * sizeof(std::uint32_t));
+    }
+    border = other.border;
+}
+
+void lem_frame::capture_raw(const galaxy::saturn::dcpu& cpu, const lem_mapping& mapping)
+{
+    connected = mapping.screen != 0;
+
+    // mapped regions wrap around the end of memory like everything else
+    for (unsigned int i = 0; i < video_words; i++)
+        video[i] = cpu.ram[static_cast<std::uint16_t>(mapping.screen + i)];
+
+    if (mapping.font != 0) {
+        for (unsigned int i = 0; i < font_words; i++)
+            font[i] = cpu.ram[static_cast<std::uint16_t>(mapping.font + i)];
+    } else {
+        font = defaults().font;
+    }
+
+    if (mapping.palette != 0) {
+        for (unsigned int i = 0; i < palette_words; i++)
+            palette[i] = cpu.ram[static_cast<std::uint16_t>(mapping.palette + i)];
+    } else {
+        palette = defaults().palette;
+    }
+
+    // palette entries are 0x0rgb, four bits per channel
+    border_index = mapping.border & 0xf;
+    std::uint16_t colour = palette[border_index];
+    border.r = ((colour >> 8) & 0xf) * 0x11;
+    border.g = ((colour >> 4) & 0xf) * 0x11;
+    border.b = (colour & 0xf) * 0x11;
+}
+
+bool lem_frame::compare_raw(const lem_frame& other) const
+{
+    return connected != other.connected || video != other.video || font != other.font || palette != other.palette
+        || border_index != other.border_index;
+}
+
+void lem_frame::copy_raw(const lem_frame& other)
+{
+    copy_words(other);
+    border = other.border;
+}
+
+void lem_frame::copy_words(const lem_frame& other)
+{
+    connected = other.connected;
+    video = other.video;
+    font = other.font;
+    palette = other.palette;
+    border_index = other.border_index;
+}
+
+bool lem_frame::blinks() const
+{
+    if (!connected)
+        return false;
+    for (unsigned int i = 0; i < video_words; i++) {
+        if (video[i] & 0x80)
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,97 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#ifndef LEM_FRAME_HPP
+#define LEM_FRAME_HPP
+
+#include <libsaturn.hpp>
+
+#include "machine.hpp"
+
+#include <array>
+#include <cstdint>
+
+/// everything a LEM1802 window needs to draw one frame, captured on the
+/// emulation thread so that the window never touches the device itself. the
+/// pixels are kept as ready-to-upload RGBA, so frames published through a
+/// triple buffer double as persistent pixel buffers and are never reallocated
+struct lem_frame {
+    static const unsigned int width = galaxy::saturn::lem1802::width;
+    static const unsigned int height = galaxy::saturn::lem1802::height;
+
+    /// changes are tracked per row of character cells
+    static const unsigned int cell_height = 8;
+    static const unsigned int cell_rows = height / cell_height;
+    static const std::uint16_t all_rows = (1 << cell_rows) - 1;
+
+    /// the words a LEM1802 displays from
+    static const unsigned int video_words = 32 * 12;
+    static const unsigned int font_words = 256;
+    static const unsigned int palette_words = 16;
+
+    /// converts the device's current image into pixels, and grabs the border
+    void capture(const galaxy::saturn::lem1802& lem);
+
+    /// instead of pixels, copies out the raw video, font and palette words
+    /// for windows that rasterise on the GPU (substituting the defaults for
+    /// unmapped font or palette), and looks up the border colour
+    void capture_raw(const galaxy::saturn::dcpu& cpu, const lem_mapping& mapping);
+
+    /// a mask with a bit set for every cell row that differs from other
+    std::uint16_t compare(const lem_frame& other) const;
+
+    /// copies over the pixels of the cell rows in mask from other
+    void copy_rows(const lem_frame& other, std::uint16_t mask);
+
+    /// whether any of the raw words differ from other
+    bool compare_raw(const lem_frame& other) const;
+
+    /// copies over the raw words and border from other
+    void copy_raw(const lem_frame& other);
+
+    /// copies over just the raw words from other
+    void copy_words(const lem_frame& other);
+
+    /// whether any cell the raw words show has its blink bit set, so that
+    /// the image changes with nothing in memory changing
+    bool blinks() const;
+
+    /// one RGBA pixel per element, in memory order r, g, b, a
+    alignas(16) std::array<std::uint32_t, width * height> pixels;
+    galaxy::saturn::color border;
+
+    /// only filled in by capture_raw(); connected is false while the
+    /// program hasn't mapped any video memory
+    std::array<std::uint16_t, video_words> video;
+    std::array<std::uint16_t, font_words> font;
+    std::array<std::uint16_t, palette_words> palette;
+    std::uint16_t border_index;
+    bool connected;
+
+    /// published frames are numbered consecutively, and know which cell rows
+    /// changed since the one before; a consumer that missed a frame has to
+    /// take the whole thing
+    std::uint64_t sequence;
+    std::uint16_t dirty_rows;
+};
+
+#endif
@@ -0,0 +1,158 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#include "loader.hpp"
+#include "dcpu_decode.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    std::uint16_t word_at(const unsigned char* bytes, std::size_t i, bool big_endian)
+    {
+        return big_endian ? (bytes[i * 2] << 8) | bytes[i * 2 + 1] : bytes[i * 2] | (bytes[i * 2 + 1] << 8);
+    }
+
+    /// how many instructions from the start of the image decode before the
+    /// first invalid one, reading it in the given byte order
+    std::size_t valid_run(const unsigned char* bytes, std::size_t words, bool big_endian)
+    {
+        std::size_t count = 0;
+        std::size_t i = 0;
+        while (i < words && count < 64) {
+            std::uint16_t word = word_at(bytes, i, big_endian);
+            if (!instruction::is_valid_word(word))
+                break;
+            count++;
+            i += 1 + instruction::has_next_word(word >> 10);
+            if ((word & 0x1f) != 0)
+                i += instruction::has_next_word((word >> 5) & 0x1f);
+        }
+        return count;
+    }
+
+    /// the swap loop; kept to plain indexed loads and stores so the compiler
+    /// can vectorise it
+    void swap_into(std::uint16_t* out, const unsigned char* bytes, std::size_t words, bool big_endian)
+    {
+        if (big_endian) {
+            for (std::size_t i = 0; i < words; i++)
+                out[i] = static_cast<std::uint16_t>((bytes[i * 2] << 8) | bytes[i * 2 + 1]);
+        } else {
+            for (std::size_t i = 0; i < words; i++)
+                out[i] = static_cast<std::uint16_t>(bytes[i * 2] | (bytes[i * 2 + 1] << 8));
+        }
+    }
+}
+
+bool parse_address(const std::string& text, std::uint16_t& address)
+{
+    char* end = 0;
+    unsigned long value = std::strtoul(text.c_str(), &end, 0);
+    if (text.empty() || *end != '\0' || value > 0xffff)
+        return false;
+
+    address = static_cast<std::uint16_t>(value);
+    return true;
+}
+
+bool parse_segment(const std::string& text, load_segment& segment)
+{
+    std::size_t at = text.rfind('@');
+    if (at == std::string::npos) {
+        segment.filename = text;
+        segment.address = 0;
+        return true;
+    }
+
+    if (!parse_address(text.substr(at + 1), segment.address))
+        return false;
+
+    segment.filename = text.substr(0, at);
+    return true;
+}
+
+bool parse_byte_order(const std::string& text, byte_order& order)
+{
+    if (text == "big")
+        order = byte_order::big;
+    else if (text == "little")
+        order = byte_order::little;
+    else if (text == "auto")
+        order = byte_order::automatic;
+    else
+        return false;
+    return true;
+}
+
+bool load_binary(galaxy::saturn::dcpu& cpu, const std::string& filename, std::uint16_t address, byte_order order)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Error: could not open file \"" << filename << "\": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        std::cerr << "Error: could not read file \"" << filename << "\": " << std::strerror(errno) << std::endl;
+        close(fd);
+        return false;
+    }
+
+    // an empty image loads nothing, and can't be mapped anyway
+    std::size_t size = info.st_size;
+    if (size < 2) {
+        close(fd);
+        return true;
+    }
+
+    void* mapping = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Error: could not map file \"" << filename << "\": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    const unsigned char* bytes = static_cast<const unsigned char*>(mapping);
+
+    std::size_t words = size / 2;
+    if (words > cpu.ram.size() - address)
+        words = cpu.ram.size() - address;
+
+    bool big_endian = order != byte_order::little;
+    if (order == byte_order::automatic)
+        big_endian = valid_run(bytes, words, true) >= valid_run(bytes, words, false);
+
+    // libsaturn's flash() always starts at address 0 and wants an iterator
+    // range, so the words go straight into ram instead
+    swap_into(cpu.ram.data() + address, bytes, words, big_endian);
+
+    munmap(mapping, size);
+    return true;
+}
@@ -0,0 +1,57 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#ifndef LOADER_HPP
+#define LOADER_HPP
+
+#include <libsaturn.hpp>
+
+#include <cstdint>
+#include <string>
+
+/// the byte order of a program image. automatic guesses from how well the
+/// start of the image decodes either way, preferring big-endian on a tie
+enum class byte_order { big, little, automatic };
+
+/// a program image and where in ram it goes
+struct load_segment {
+    std::string filename;
+    std::uint16_t address;
+};
+
+/// parses a 16 bit address, in decimal or 0x hex
+bool parse_address(const std::string& text, std::uint16_t& address);
+
+/// parses "FILE" or "FILE@ADDRESS" (address in decimal or 0x hex); returns
+/// false if the address isn't a 16 bit number
+bool parse_segment(const std::string& text, load_segment& segment);
+
+/// parses "big", "little" or "auto"
+bool parse_byte_order(const std::string& text, byte_order& order);
+
+/// maps a program image and swaps it word by word straight into the cpu's ram
+/// at address, leaving the rest of ram alone. anything past the end of ram is
+/// dropped, as is an odd trailing byte. returns false (having printed why) if
+/// the file couldn't be read
+bool load_binary(galaxy::saturn::dcpu& cpu, const std::string& filename, std::uint16_t address = 0, byte_order order = byte_order::big);
+
+#endif
@@ -0,0 +1,503 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#include "machine.hpp"
+#include "dcpu_core.hpp"
+#include "mmap_disk.hpp"
+#include "overlay_disk.hpp"
+#ifdef SATURN_THREADED_CORE
+#include "threaded_core.hpp"
+#endif
+
+#include <algorithm>
+#include <iomanip>
+
+machine::machine(int num_lems, int num_speds, const std::list<std::string>& disk_filenames, disk_backend backend, cpu_backend cpu_core) : cycles(0), disk_filenames(disk_filenames),
+    watch_hwi(false), fast_forward(true), skipped_cycles(0), clock_interval(0), clock_message(0), keyboard_message(0), ran(0), queueing(false), calm(queue_limit), resuming(false), resume_pc(0)
+{
+    // the order in which devices are attached decides their hardware index,
+    // so keep it stable: floppies, monitors, SPED-3's, then the clock and keyboard
+    for (auto it = disk_filenames.begin(); it != disk_filenames.end(); ++it) {
+        galaxy::saturn::m35fd* drive = new galaxy::saturn::m35fd();
+        attach(drive);
+        if (backend == disk_backend::mmap)
+            drive->insert_disk(new mmap_disk(*it));
+        else if (backend == disk_backend::overlay || backend == disk_backend::overlay_commit)
+            drive->insert_disk(new overlay_disk(*it, backend == disk_backend::overlay_commit));
+        else
+            drive->insert_disk(new galaxy::saturn::fstream_disk(*it));
+        drives.push_back(drive);
+    }
+    drive_messages.resize(drives.size());
+    drive_busy_until.resize(drives.size());
+
+    for (int i = 0; i < num_lems; i++) {
+        galaxy::saturn::lem1802* lem = new galaxy::saturn::lem1802();
+        attach(lem);
+        lems.push_back(lem);
+    }
+    lem_mappings.resize(lems.size());
+
+    for (int i = 0; i < num_speds; i++) {
+        galaxy::saturn::sped3* sped = new galaxy::saturn::sped3();
+        attach(sped);
+        speds.push_back(sped);
+    }
+    sped_mappings.resize(speds.size());
+
+    clock = new galaxy::saturn::clock();
+    attach(clock);
+    keyboard = new galaxy::saturn::keyboard();
+    attach(keyboard);
+
+    // a core ticks the devices itself, so it has to know all of them; the
+    // schedule also keeps track of which are busy for idling()
+    schedule.reset(new device_schedule(devices, clock, keyboard, std::vector<galaxy::saturn::device*>(drives.begin(), drives.end())));
+    if (cpu_core == cpu_backend::cached)
+        core.reset(new dcpu_core(cpu, *schedule, stops));
+#ifdef SATURN_THREADED_CORE
+    else if (cpu_core == cpu_backend::threaded)
+        core.reset(new threaded_core(cpu, *schedule, stops));
+#endif
+}
+
+const char* cpu_backend_name(cpu_backend backend)
+{
+    switch (backend) {
+        case cpu_backend::cached:
+            return "cached";
+        case cpu_backend::threaded:
+            return "threaded";
+        case cpu_backend::reference:
+            break;
+    }
+    return "reference";
+}
+
+bool parse_cpu_backend(const std::string& text, cpu_backend& backend)
+{
+    if (text == "reference")
+        backend = cpu_backend::reference;
+    else if (text == "cached")
+        backend = cpu_backend::cached;
+#ifdef SATURN_THREADED_CORE
+    else if (text == "threaded")
+        backend = cpu_backend::threaded;
+#endif
+    else
+        return false;
+    return true;
+}
+
+std::vector<cpu_backend> cpu_backends()
+{
+    std::vector<cpu_backend> backends;
+    backends.push_back(cpu_backend::reference);
+    backends.push_back(cpu_backend::cached);
+#ifdef SATURN_THREADED_CORE
+    backends.push_back(cpu_backend::threaded);
+#endif
+    return backends;
+}
+
+void machine::attach(galaxy::saturn::device* device)
+{
+    // the dcpu takes ownership
+    devices.push_back(&cpu.attach_device(device));
+}
+
+void machine::send_hwi(galaxy::saturn::device* device, std::uint16_t a, std::uint16_t b, std::uint16_t x, std::uint16_t y)
+{
+    std::uint16_t saved[] = { cpu.A, cpu.B, cpu.X, cpu.Y };
+
+    watch.valid = false;
+
+    schedule->hwi(std::find(devices.begin(), devices.end(), device) - devices.begin(), a, b);
+
+    cpu.A = a;
+    cpu.B = b;
+    cpu.X = x;
+    cpu.Y = y;
+    device->interrupt();
+
+    cpu.A = saved[0];
+    cpu.B = saved[1];
+    cpu.X = saved[2];
+    cpu.Y = saved[3];
+}
+
+run_result machine::run(std::uint64_t budget)
+{
+    run_result result;
+    result.cycles = 0;
+    result.reason = stop_reason::budget;
+    result.address = 0;
+    bool idled = false;
+
+    if (resuming && cpu.PC != resume_pc)
+        resuming = false;
+
+    try {
+        while (result.cycles < budget) {
+            if (core) {
+                core->stop_at_spins = fast_forward;
+                core->run(budget, result.cycles);
+                if (result.cycles == budget)
+                    break;
+            }
+
+            // whatever the core left is run here a cycle at a time: HWIs,
+            // every cycle while interrupts are enabled, and anything else
+            // only libsaturn does
+            std::uint16_t pc = cpu.PC;
+            std::uint16_t sp = cpu.SP;
+            std::uint16_t a = cpu.A;
+            std::uint16_t interrupt_address = cpu.IA;
+            bool hwi = (cpu.ram[pc] & instruction::HWI_MASK) == instruction::HWI_WORD;
+            bool spins = !hwi && fast_forward && spins_at(pc);
+            bool stacked_before = interrupt_address != 0 && stacked(sp, pc, a);
+
+            if (stops.is_breakpoint(pc) && !(resuming && pc == resume_pc)) {
+                result.reason = stop_reason::breakpoint;
+                resuming = true;
+                resume_pc = pc;
+                break;
+            }
+            resuming = false;
+            if (hwi && stop_before() == stop_reason::halt) {
+                result.reason = stop_reason::halt;
+                break;
+            }
+
+            // the write is worked out beforehand, since the instruction may
+            // change the registers it depends on
+            std::uint16_t written = 0;
+            bool watched = stops.watching() && written_address(cpu, decode(cpu.ram, pc), written) && stops.is_watched(written);
+
+            // the rest of the budget that doesn't make up a whole time round
+            // is run as usual, so the program ends up where it would have.
+            // skipping would go straight past any stop points in the loop
+            std::uint64_t period;
+            if (!idled && fast_forward && stops.empty() && (hwi || spins) && idling(spins, ran + result.cycles, period)) {
+                std::uint64_t skipped = (budget - result.cycles) / period * period;
+                schedule->idle(skipped);
+                result.cycles += skipped;
+                skipped_cycles += skipped;
+                idled = true;
+                if (result.cycles == budget)
+                    break;
+            }
+
+            queue_watch q = before_cycle();
+            if (hwi)
+                hwi_cycle();
+            else
+                cpu.cycle();
+            after_cycle(q, true);
+            schedule->elapse(1);
+            result.cycles++;
+
+            // libsaturn doesn't say when it delivers an interrupt, but it
+            // leaves the interrupted PC and A on the stack when it does. the
+            // stack can still hold them from the last interrupt at this PC,
+            // so then SP has to have moved to match too
+            if (interrupt_address != 0 && stacked(sp, pc, a) && (!stacked_before || cpu.SP == static_cast<std::uint16_t>(sp - 2))) {
+                // the handler can change anything, so whatever loop the
+                // program was idling in has to be seen to come round again
+                watch.valid = false;
+                result.reason = stop_reason::interrupt;
+                break;
+            }
+            if (watched) {
+                result.reason = stop_reason::watchpoint;
+                result.address = written;
+                break;
+            }
+            if (hwi && !idled) {
+                result.reason = stop_reason::hwi;
+                break;
+            }
+        }
+    } catch(galaxy::saturn::invalid_opcode& e) {
+        result.reason = stop_reason::invalid_opcode;
+    }
+
+    if (idled && result.reason == stop_reason::budget)
+        result.reason = stop_reason::idle;
+    ran += result.cycles;
+    return result;
+}
+
+bool machine::idling(bool spins, std::uint64_t now, std::uint64_t& period)
+{
+    // the clock or a drive may be about to interrupt or write to memory
+    if (!schedule->passive()) {
+        watch.valid = false;
+        return false;
+    }
+
+    // round a loop with an HWI in it memory may still be changing, and a
+    // loop that's busy that way shouldn't pay for a look every time round
+    bool same_place = watch.valid && watch.pc == cpu.PC;
+    if (same_place && watch.wait > 0) {
+        watch.wait--;
+        return false;
+    }
+    if (!same_place) {
+        watch.backoff = 1;
+        watch.wait = 0;
+    }
+
+    std::uint16_t registers[] = { cpu.A, cpu.B, cpu.C, cpu.X, cpu.Y, cpu.Z, cpu.I, cpu.J, cpu.SP, cpu.EX, cpu.IA };
+    const std::size_t count = sizeof(registers) / sizeof(registers[0]);
+    if (!same_place || !std::equal(registers, registers + count, watch.registers)) {
+        watch.valid = true;
+        watch.pc = cpu.PC;
+        std::copy(registers, registers + count, watch.registers);
+        watch.ram_saved = false;
+        watch.period = 0;
+        return false;
+    }
+
+    // a self-jump changes nothing, so having come back to it at all is
+    // enough, and it comes back every cycle. with interrupts enabled, a
+    // handler may have run in between and changed memory, so then memory is
+    // compared like any other loop's
+    if (spins && cpu.IA == 0) {
+        period = 1;
+        return true;
+    }
+
+    if (watch.ram_saved && std::equal(cpu.ram.begin(), cpu.ram.end(), watch.ram.begin())) {
+        // every time the program has come back to the same state is a whole
+        // number of times round, so the shortest is too. the saved memory is
+        // as good as a copy taken now
+        std::uint64_t since = now - watch.ram_at;
+        watch.period = watch.period == 0 ? since : std::min(watch.period, since);
+        watch.ram_at = now;
+        period = watch.period;
+        return true;
+    }
+
+    if (watch.ram_saved) {
+        watch.backoff = std::min<std::uint32_t>(watch.backoff * 2, 0x10000);
+        watch.wait = watch.backoff;
+    }
+    watch.ram.assign(cpu.ram.begin(), cpu.ram.end());
+    watch.ram_at = now;
+    watch.ram_saved = true;
+    return false;
+}
+
+bool machine::spins_at(std::uint16_t pc) const
+{
+    // only SET, ADD and SUB with PC as b can jump to themselves; check for
+    // that before decoding, since this is looked at every cycle
+    std::uint16_t word = cpu.ram[pc];
+    std::uint8_t opcode = word & 0x1f;
+    if (((word >> 5) & 0x1f) != instruction::PC || (opcode != instruction::SET && opcode != instruction::ADD && opcode != instruction::SUB))
+        return false;
+    return decode(cpu.ram, pc).is_self_jump();
+}
+
+void machine::set_breakpoint(std::uint16_t address, bool set)
+{
+    stops.set_breakpoint(address, set);
+    if (core)
+        core->forget(address);
+}
+
+void machine::set_watchpoint(std::uint16_t address, bool set)
+{
+    // which instructions might write to a watched word can change anywhere
+    stops.set_watched(address, set);
+    if (core)
+        core->forget_all();
+}
+
+stop_reason machine::stop_before() const
+{
+    instruction ins = decode(cpu.ram, cpu.PC);
+    if (ins.is_special() && ins.special == instruction::HWI && peek_operand(cpu, ins.a, ins.next_a) == halt_index)
+        return stop_reason::halt;
+    if (stops.is_breakpoint(cpu.PC))
+        return stop_reason::breakpoint;
+    return stop_reason::budget;
+}
+
+void machine::dump_registers(std::ostream& out) const
+{
+    static const char* names[] = { "A", "B", "C", "X", "Y", "Z", "I", "J", "PC", "SP", "EX", "IA" };
+    const std::uint16_t values[] = { cpu.A, cpu.B, cpu.C, cpu.X, cpu.Y, cpu.Z, cpu.I, cpu.J, cpu.PC, cpu.SP, cpu.EX, cpu.IA };
+
+    out << std::hex << std::setfill('0');
+    for (std::size_t i = 0; i < 12; i++)
+        out << names[i] << "=" << std::setw(4) << values[i] << (i == 7 || i == 11 ? "\n" : " ");
+    out << std::dec << std::setfill(' ');
+}
+
+int exit_status(const machine& m, stop_reason reason, bool stop_expected)
+{
+    switch (reason) {
+        case stop_reason::invalid_opcode:
+            return 1;
+        case stop_reason::halt:
+            return m.cpu.A & 0xff;
+        case stop_reason::breakpoint:
+        case stop_reason::watchpoint:
+            return 0;
+        default:
+            break;
+    }
+    return stop_expected ? 2 : 0;
+}
+
+void report_stop(std::ostream& out, const machine& m, stop_reason reason)
+{
+    switch (reason) {
+        case stop_reason::invalid_opcode:
+            out << "Error: invalid opcode: 0x" << std::hex << m.cpu.ram[m.cpu.PC] << " at 0x" << m.cpu.PC << std::dec << std::endl;
+            break;
+        case stop_reason::halt:
+            out << "Program halted with status " << (m.cpu.A & 0xff) << std::endl;
+            break;
+        case stop_reason::breakpoint:
+            out << "Stopped at 0x" << std::hex << m.cpu.PC << std::dec << std::endl;
+            break;
+        case stop_reason::watchpoint:
+            out << "Stopped after a write to a watched address, at 0x" << std::hex << m.cpu.PC << std::dec << std::endl;
+            break;
+        default:
+            break;
+    }
+}
+
+bool machine::stacked(std::uint16_t sp, std::uint16_t pc, std::uint16_t a) const
+{
+    return cpu.ram[static_cast<std::uint16_t>(sp - 1)] == pc && cpu.ram[static_cast<std::uint16_t>(sp - 2)] == a;
+}
+
+void machine::hwi_cycle()
+{
+    // the device is woken even if an interrupt gets in first and the HWI
+    // doesn't run this cycle, which does no harm
+    instruction ins = decode(cpu.ram, cpu.PC);
+    schedule->hwi(peek_operand(cpu, ins.a, ins.next_a), cpu.A, cpu.B);
+
+    if (watch_hwi)
+        watched_cycle();
+    else
+        cpu.cycle();
+}
+
+void machine::watched_cycle()
+{
+    instruction ins = decode(cpu.ram, cpu.PC);
+    std::uint16_t index = peek_operand(cpu, ins.a, ins.next_a);
+    std::uint16_t a = cpu.A;
+    std::uint16_t b = cpu.B;
+    std::uint16_t x = cpu.X;
+    std::uint16_t y = cpu.Y;
+
+    cpu.cycle();
+
+    // the HWI only went through if we ended up just past it; otherwise an
+    // interrupt got in first, and we'll see the HWI again later
+    if (cpu.PC != static_cast<std::uint16_t>(ins.address + ins.length) || index >= devices.size())
+        return;
+
+    for (std::size_t i = 0; i < lems.size(); i++) {
+        if (devices[index] != lems[i])
+            continue;
+
+        lem_mapping& mapping = lem_mappings[i];
+        switch (a) {
+            case 0: mapping.screen = b; break;
+            case 1: mapping.font = b; break;
+            case 2: mapping.palette = b; break;
+            case 3: mapping.border = b & 0xf; break;
+        }
+    }
+
+    for (std::size_t i = 0; i < speds.size(); i++) {
+        if (devices[index] != speds[i])
+            continue;
+
+        sped_mapping& mapping = sped_mappings[i];
+        switch (a) {
+            case 1: mapping.address = x; mapping.count = y; break;
+            case 2: mapping.rotation = x % 360; break;
+        }
+    }
+
+    if (devices[index] == clock) {
+        if (a == 0)
+            clock_interval = b;
+        else if (a == 2)
+            clock_message = b;
+    } else if (devices[index] == keyboard) {
+        if (a == 3)
+            keyboard_message = b;
+    }
+
+    for (std::size_t i = 0; i < drives.size(); i++) {
+        if (devices[index] != drives[i])
+            continue;
+
+        if (a == 1)
+            drive_messages[i] = x;
+        else if (a == 2 || a == 3)
+            drive_busy_until[i] = schedule->ticks() + device_schedule::wake_cycles;
+    }
+}
+
+machine::queue_watch machine::before_cycle() const
+{
+    queue_watch q;
+    q.word = cpu.ram[cpu.PC];
+    q.iaq = 0;
+    q.enabled = cpu.IA != 0;
+    if ((q.word & instruction::HWI_MASK) == instruction::IAQ << 5) {
+        instruction ins = decode(cpu.ram, cpu.PC);
+        q.iaq = peek_operand(cpu, ins.a, ins.next_a);
+    }
+    return q;
+}
+
+void machine::after_cycle(const queue_watch& q, bool drained)
+{
+    // an interrupt getting in leaves PC at IA, which could also be a jump
+    // there; taking it for an interrupt only errs on the careful side
+    if (q.enabled && cpu.PC == cpu.IA)
+        queueing = true;
+    else if ((q.word & instruction::HWI_MASK) == instruction::RFI << 5)
+        queueing = false;
+    else if ((q.word & instruction::HWI_MASK) == instruction::IAQ << 5)
+        queueing = q.iaq != 0;
+
+    // by the spec an interrupt with IA 0 is dropped rather than queued, and
+    // libsaturn takes one off the queue a cycle while it isn't queueing
+    if (q.enabled || cpu.IA != 0)
+        calm = 0;
+    else if (drained && calm < queue_limit)
+        calm++;
+}
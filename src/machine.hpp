@@ -0,0 +1,311 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#ifndef MACHINE_HPP
+#define MACHINE_HPP
+
+#include <libsaturn.hpp>
+
+#include "dcpu_decode.hpp"
+#include "cpu_core.hpp"
+#include "device_schedule.hpp"
+#include "stop_points.hpp"
+
+#include <cstdint>
+#include <list>
+#include <ostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+/// what a LEM1802 has been told to display from, as seen from the HWIs sent
+/// to it; zero means disconnected for the screen and the default otherwise
+struct lem_mapping {
+    lem_mapping() : screen(0), font(0), palette(0), border(0) {}
+
+    std::uint16_t screen;
+    std::uint16_t font;
+    std::uint16_t palette;
+    std::uint16_t border;
+};
+
+/// what a SPED-3 has been told to project, as seen from the HWIs sent to it
+struct sped_mapping {
+    sped_mapping() : address(0), count(0), rotation(0) {}
+
+    std::uint16_t address;
+    std::uint16_t count;
+    /// the target rotation, in degrees
+    std::uint16_t rotation;
+};
+
+/// how floppy images are accessed: through libsaturn's fstream_disk, mapped
+/// into memory with mmap_disk, or copy-on-write with overlay_disk, whose
+/// writes are either thrown away or committed to the image at exit
+enum class disk_backend { fstream, mmap, overlay, overlay_commit };
+
+/// what runs the program: libsaturn's dcpu::cycle(), saturn's own dcpu_core
+/// with its cache of decoded instructions, or threaded_core, which is only
+/// there when built with SATURN_THREADED_CORE
+enum class cpu_backend { reference, cached, threaded };
+
+/// "reference", "cached" or "threaded"; parse_cpu_backend returns false for
+/// anything else, and for backends this build doesn't have
+const char* cpu_backend_name(cpu_backend backend);
+bool parse_cpu_backend(const std::string& text, cpu_backend& backend);
+
+/// every backend this build has, reference first
+std::vector<cpu_backend> cpu_backends();
+
+/// why machine::run came back: it ran its whole budget, it ran an HWI (which
+/// may have changed a device's configuration), an interrupt was delivered,
+/// the instruction at PC is an invalid opcode, which was left unexecuted, or
+/// the program went idle and the rest of the budget was skipped. the rest are
+/// the program's doing: PC is at a breakpoint, an instruction just wrote to a
+/// watched word, or the instruction at PC is the halt HWI (see machine)
+enum class stop_reason { budget, hwi, interrupt, invalid_opcode, idle, breakpoint, watchpoint, halt };
+
+struct run_result {
+    /// cycles actually executed, counting the HWI or the interrupted one, and
+    /// the ones skipped when idle
+    std::uint64_t cycles;
+    stop_reason reason;
+    /// for a watchpoint, the word that was written
+    std::uint16_t address;
+};
+
+/// whether a run has to end for reason, rather than carry on
+inline bool is_final(stop_reason reason)
+{
+    return reason == stop_reason::invalid_opcode || reason == stop_reason::breakpoint || reason == stop_reason::watchpoint
+        || reason == stop_reason::halt;
+}
+
+/// a dcpu along with every device saturn attaches to it; the devices are owned
+/// by the dcpu, we just keep typed references around so that the front ends
+/// (windows, headless runner, etc) can get at them
+class machine {
+    public:
+        /// the hardware index that, sent an HWI, stops the run with the exit
+        /// status in A. there's never a device there, so programs that don't
+        /// know about it never send to it
+        static const std::uint16_t halt_index = 0xffff;
+
+        /// throws std::runtime_error if a disk image can't be opened
+        machine(int num_lems, int num_speds, const std::list<std::string>& disk_filenames, disk_backend backend = disk_backend::fstream,
+            cpu_backend cpu_core = cpu_backend::reference);
+
+        /// runs a single cycle. HWIs are looked at on their way through, for
+        /// watch_hwi and the schedule, which costs a check of the word at PC
+        /// per cycle
+        void cycle()
+        {
+            queue_watch q = before_cycle();
+            if ((q.word & instruction::HWI_MASK) == instruction::HWI_WORD) {
+                hwi_cycle();
+                schedule->elapse(1);
+            } else if (core) {
+                core->step();
+            } else {
+                cpu.cycle();
+                schedule->elapse(1);
+            }
+            after_cycle(q, !core);
+        }
+
+        /// runs up to budget cycles, coming back early for an HWI, an
+        /// interrupt or an invalid opcode. with the cached backend the core
+        /// runs straight through everything in between, without returning
+        /// here for each instruction. doesn't add to cycles, which is up to
+        /// the caller as with cycle().
+        ///
+        /// with fast_forward set, a program found going round a loop that
+        /// nothing but the host can get it out of is skipped through as many
+        /// whole times round as fit in the budget (see idling()), and doesn't
+        /// stop for its HWIs after that; callers cut budgets short at input,
+        /// as they do anyway to deliver it on the right cycle, and call
+        /// input_arrived() once it's in
+        run_result run(std::uint64_t budget);
+
+        /// tells run() the program may see something new (a key), so a loop
+        /// it was idling in may be about to go somewhere
+        void input_arrived() { watch.valid = false; }
+
+        /// lets devices that the spec says have nothing to do go unticked by
+        /// saturn's cores (see device_schedule). off by default, since
+        /// libsaturn's devices haven't been checked to keep to the spec
+        void let_devices_sleep(bool sleep) { schedule->let_sleep(sleep); }
+
+        /// makes run() stop before the instruction at address, or stops it
+        /// doing so. run() steps over a breakpoint when it starts out on the
+        /// one it last stopped at, so calling it again carries on from there
+        void set_breakpoint(std::uint16_t address, bool set);
+
+        /// makes run() stop after an instruction writes to the word at
+        /// address, or stops it doing so
+        void set_watchpoint(std::uint16_t address, bool set);
+
+        /// halt if the instruction at PC is the halt HWI, breakpoint if
+        /// there's a breakpoint on it, and budget otherwise
+        stop_reason stop_before() const;
+
+        /// whether libsaturn can't have any interrupts queued, nor be queueing
+        /// them: IA is 0, and has been for long enough that any left over from
+        /// before have gone. see queueing
+        bool interrupts_settled() const { return cpu.IA == 0 && !queueing && calm >= queue_limit; }
+
+        /// whether the drive may still be reading or writing a sector, which
+        /// is taken to be for device_schedule::wake_cycles after an HWI that
+        /// starts either. only seen while watch_hwi is set
+        bool drive_busy(std::size_t index) const { return schedule->ticks() < drive_busy_until[index]; }
+
+        /// prints the registers, for when a run has ended
+        void dump_registers(std::ostream& out) const;
+
+        /// sends an interrupt straight to a device, as if the program had set
+        /// registers A, B, X and Y and HWI'd it; the cpu's registers are left
+        /// as they were. used to put devices back into a known configuration
+        void send_hwi(galaxy::saturn::device* device, std::uint16_t a, std::uint16_t b, std::uint16_t x, std::uint16_t y);
+
+        galaxy::saturn::dcpu cpu;
+
+        /// cycles executed so far; the front ends add to this as they go
+        std::uint64_t cycles;
+
+        /// the disk images the drives were loaded with, in drive order
+        std::list<std::string> disk_filenames;
+
+        /// every attached device, by hardware index
+        std::vector<galaxy::saturn::device*> devices;
+
+        std::vector<galaxy::saturn::m35fd*> drives;
+        std::vector<galaxy::saturn::lem1802*> lems;
+        std::vector<galaxy::saturn::sped3*> speds;
+        galaxy::saturn::clock* clock;
+        galaxy::saturn::keyboard* keyboard;
+
+        bool watch_hwi;
+
+        /// whether run() skips through idle loops; on by default
+        bool fast_forward;
+
+        /// of the cycles run() has returned, how many it skipped rather than
+        /// executed, going through idle loops
+        std::uint64_t skipped_cycles;
+
+        /// kept up to date from the HWIs seen while watch_hwi is set
+        std::vector<lem_mapping> lem_mappings;
+        std::vector<sped_mapping> sped_mappings;
+        std::uint16_t clock_interval;
+        std::uint16_t clock_message;
+        std::uint16_t keyboard_message;
+        std::vector<std::uint16_t> drive_messages;
+    private:
+        /// which devices are awake; a core ticks them through it, and
+        /// core is null when libsaturn runs the program by itself
+        std::unique_ptr<device_schedule> schedule;
+        std::unique_ptr<cpu_core> core;
+
+        /// the program as it was at the last HWI or self-jump run() came to.
+        /// memory is only compared once the registers have matched, and after
+        /// each time it doesn't, twice as many rounds go by before the next try
+        struct idle_watch {
+            idle_watch() : valid(false), period(0), ram_saved(false), backoff(1), wait(0) {}
+
+            bool valid;
+            std::uint16_t pc;
+            std::uint16_t registers[11];
+            std::vector<std::uint16_t> ram;
+            /// when ram was saved, in cycles run() has been through, and the
+            /// shortest time round the loop seen, or zero
+            std::uint64_t ram_at;
+            std::uint64_t period;
+            bool ram_saved;
+            std::uint32_t backoff;
+            std::uint32_t wait;
+        };
+        idle_watch watch;
+        std::uint64_t ran;
+
+        /// libsaturn keeps its interrupt queue to itself, so what it might hold
+        /// is worked out around each cycle it may run. queueing is whether IAQ
+        /// may be set: an interrupt getting in sets it, IAQ sets it to its
+        /// operand and RFI clears it. calm counts the cycles libsaturn has run
+        /// since IA was last set, up to the queue_limit it takes to deliver
+        /// (or, with IA 0, drop) a full queue; the cores' own cycles don't
+        /// take anything off it, so don't count
+        struct queue_watch {
+            std::uint16_t word;
+            std::uint16_t iaq;
+            bool enabled;
+        };
+        static const std::uint16_t queue_limit = 256;
+        queue_watch before_cycle() const;
+        /// drained is false if the core may have run the instruction itself
+        void after_cycle(const queue_watch& q, bool drained);
+        bool queueing;
+        std::uint16_t calm;
+
+        /// by drive, the schedule's tick each is taken to be busy until
+        std::vector<std::uint64_t> drive_busy_until;
+
+        stop_points stops;
+
+        /// the breakpoint run() last stopped at, if it's still at it
+        bool resuming;
+        std::uint16_t resume_pc;
+
+        /// whether the program, about to run the HWI or self-jump at PC, has
+        /// come round to exactly where it was the last time with no device
+        /// awake that could change that. it'll then go round the same way,
+        /// once every period cycles, until something from the host (a key,
+        /// mostly) arrives
+        bool idling(bool spins, std::uint64_t now, std::uint64_t& period);
+
+        /// whether the instruction at pc only jumps to itself
+        bool spins_at(std::uint16_t pc) const;
+
+        /// runs a cycle with an HWI at PC
+        void hwi_cycle();
+        void watched_cycle();
+
+        /// whether the two words pushed below sp are pc and then a, as an
+        /// interrupt leaves them
+        bool stacked(std::uint16_t sp, std::uint16_t pc, std::uint16_t a) const;
+        void attach(galaxy::saturn::device* device);
+
+        // machines hold references into their own dcpu, so they stay put
+        machine(const machine&);
+        machine& operator=(const machine&);
+};
+
+/// the process exit status for a run that ended for reason: 1 for an invalid
+/// opcode, the low byte of A for the halt HWI and 0 for a breakpoint or
+/// watchpoint. a run that ran out of cycles or time gets 2 if it was meant to
+/// stop itself at one of those, and 0 otherwise
+int exit_status(const machine& m, stop_reason reason, bool stop_expected);
+
+/// says why a run ended, for reasons where is_final is true; prints nothing
+/// for the others
+void report_stop(std::ostream& out, const machine& m, stop_reason reason);
+
+#endif
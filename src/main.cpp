@@ -24,33 +24,39 @@ file named "LICENSE.txt".
 #include <libsaturn.hpp>
 
 /* implementation specific */
+#include "machine.hpp"
+#include "loader.hpp"
+#include "snapshot.hpp"
+#include "headless.hpp"
+#include "farm.hpp"
+#include "gdb_stub.hpp"
+#include "emulation_thread.hpp"
+#include "cycle_pacer.hpp"
 #include "LEM1802Window.hpp"
 #include "SPED3Window.hpp"
 #include "keyboard_adaptor.hpp"
+#include "input_log.hpp"
+#include "metrics.hpp"
 
 /* standard library */
-#include <fstream>
+#include <chrono>
 #include <iostream>
+#include <list>
 #include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 /* third party */
 #include "OptionParser.h"
 #include <SFML/Graphics.hpp>
 
-void attach_m35fd(galaxy::saturn::dcpu& cpu, std::string filename){
-    // create a new floppy drive, attach it to the cpu, and store a reference
-    galaxy::saturn::m35fd& m35fd_ref = static_cast<galaxy::saturn::m35fd&>(cpu.attach_device(new galaxy::saturn::m35fd()));
-
-    m35fd_ref.insert_disk(new galaxy::saturn::fstream_disk(filename));
-}
-
-
 int main(int argc, char** argv)
 {
     // setup the command line argument parser
     optparse::OptionParser parser = optparse::OptionParser()
         .description("Saturn, Galaxy's emulator")
-        .usage("usage: %prog [options] <binary>");
+        .usage("usage: %prog [options] <binary>[@address]");
 
     parser.add_option("-n", "--num_lems")
         .dest("num_lems")
@@ -69,19 +75,176 @@ int main(int argc, char** argv)
                           // the user to specify this more than once
         .help("Attach a floppy with a disk image loaded");
 
+    parser.add_option("-l", "--load")
+        .dest("segments")
+        .action("append")
+        .help("Load another image into memory, as FILE@ADDRESS");
+
+    parser.add_option("--byte-order")
+        .dest("byte_order")
+        .help("Byte order of the images: big (default), little or auto");
+
+    parser.add_option("--disk-backend")
+        .dest("disk_backend")
+        .help("How floppy images are accessed: fstream (default), mmap, overlay (copy-on-write, discarded at exit) or overlay-commit (copy-on-write, saved at exit)");
+
+    parser.add_option("--cpu-backend")
+        .dest("cpu_backend")
+        .help("What runs the program: reference (libsaturn, default), cached (saturn's own interpreter, with a cache of decoded instructions) or threaded (the same with direct-threaded dispatch, if built with SATURN_THREADED_CORE)");
+
+    parser.add_option("--headless")
+        .dest("headless")
+        .action("store_true")
+        .help("Run without any windows, as fast as possible");
+
+    parser.add_option("--farm")
+        .dest("farm")
+        .type("int")
+        .help("Run this many copies of the program headlessly, across all cores, and report their combined clock rate");
+
+    parser.add_option("--threads")
+        .dest("threads")
+        .type("int")
+        .help("With --farm, the number of worker threads (default: one per core)");
+
+    parser.add_option("--max-cycles")
+        .dest("max_cycles")
+        .type("long")
+        .help("In headless mode, stop after this many cycles (per instance, with --farm)");
+
+    parser.add_option("--time-limit")
+        .dest("time_limit")
+        .type("double")
+        .help("In headless mode, stop after this many seconds");
+
+    parser.add_option("--exit-on-pc")
+        .dest("exit_on_pc")
+        .action("append")
+        .help("Stop once PC reaches this address (can be given more than once)");
+
+    parser.add_option("--exit-on-write")
+        .dest("exit_on_write")
+        .action("append")
+        .help("Stop once the program writes to this address (can be given more than once)");
+
+    parser.add_option("--speed")
+        .dest("speed")
+        .help("Clock speed multiplier, e.g. 0.5x, 2x or unlimited (default: 1x, or unlimited when headless)");
+
+    parser.add_option("--no-fast-forward")
+        .dest("no_fast_forward")
+        .action("store_true")
+        .help("Run through loops the program is idling in instead of skipping them");
+
+    parser.add_option("--sleep-devices")
+        .dest("sleep_devices")
+        .action("store_true")
+        .help("Stop ticking devices the spec says are idle (faster, but unchecked against libsaturn's devices)");
+
+    parser.add_option("--lem-shader")
+        .dest("lem_shader")
+        .action("store_true")
+        .help("Rasterise LEM1802 screens on the GPU");
+
+    parser.add_option("--save-state")
+        .dest("save_state")
+        .help("Save a snapshot of the machine to this file when the run ends; refused while interrupts are enabled or may be queued, or a floppy read or write may be in flight, and the clock's phase and keyboard buffer are lost");
+
+    parser.add_option("--load-state")
+        .dest("load_state")
+        .help("Start from a snapshot instead of a binary; its devices replace -n, -s and -d");
+
+    parser.add_option("--record")
+        .dest("record")
+        .help("Log every keyboard event, with the cycle it arrived at, to this file");
+
+    parser.add_option("--replay")
+        .dest("replay")
+        .help("In headless mode, feed the keyboard the events logged by --record");
+
+    parser.add_option("--profile")
+        .dest("profile")
+        .help("Count where emulated time goes, and write a flat profile to this file (and collapsed stacks to FILE.folded) at exit");
+
+    parser.add_option("--symbols")
+        .dest("symbols")
+        .help("With --profile, name addresses from this symbol map (address and label per line, e.g. from an assembler listing)");
+
+    parser.add_option("--gdb")
+        .dest("gdb")
+        .help("Run headless under a debugger speaking GDB's remote protocol, waiting for it on this TCP port on localhost or on a UNIX socket given as unix:PATH");
+
+    parser.add_option("--metrics")
+        .dest("metrics")
+        .help("Time each phase of the main loop and dump the counters in Prometheus text format, to stderr or to a UNIX socket given as unix:PATH");
+
+    parser.add_option("--metrics-interval")
+        .dest("metrics_interval")
+        .type("double")
+        .help("With --metrics stderr, seconds between dumps (default: 10)");
+
+    parser.add_option("--show-rate")
+        .dest("show_rate")
+        .action("store_true")
+        .help("Print the measured clock rate every second");
+
     // parse the buggers - Dom
     optparse::Values options = parser.parse_args(argc, argv);
     std::vector<std::string> args = parser.args();
 
-    if (args.empty())
+    std::string save_state = std::string(options.get("save_state"));
+    std::string load_state = std::string(options.get("load_state"));
+
+    if (args.empty() && load_state == "")
     {
         // if no positional (required) arguments were provided, print help and exit
         parser.print_help();
         return -1;
     }
 
-    // the binary filename is the first of the positional arguments
-    std::string binary_filename = args[0];
+    // the binary is the first of the positional arguments, and any -l images
+    // are loaded on top of it in order
+    std::list<load_segment> segments;
+    std::list<std::string> segment_texts = options.all("segments");
+    if (!args.empty())
+        segment_texts.push_front(args[0]);
+    for (auto it = segment_texts.begin(); it != segment_texts.end(); ++it) {
+        load_segment segment;
+        if (!parse_segment(*it, segment)) {
+            std::cerr << "Error: invalid load address in \"" << *it << "\"" << std::endl;
+            return -1;
+        }
+        segments.push_back(segment);
+    }
+
+    // the run stops itself at these, so is expected to reach one
+    std::list<std::uint16_t> exit_pcs, exit_writes;
+    std::list<std::string> exit_pc_texts = options.all("exit_on_pc");
+    std::list<std::string> exit_write_texts = options.all("exit_on_write");
+    for (auto it = exit_pc_texts.begin(); it != exit_pc_texts.end(); ++it) {
+        std::uint16_t address;
+        if (!parse_address(*it, address)) {
+            std::cerr << "Error: invalid address \"" << *it << "\"" << std::endl;
+            return -1;
+        }
+        exit_pcs.push_back(address);
+    }
+    for (auto it = exit_write_texts.begin(); it != exit_write_texts.end(); ++it) {
+        std::uint16_t address;
+        if (!parse_address(*it, address)) {
+            std::cerr << "Error: invalid address \"" << *it << "\"" << std::endl;
+            return -1;
+        }
+        exit_writes.push_back(address);
+    }
+    bool stop_expected = !exit_pcs.empty() || !exit_writes.empty();
+
+    byte_order order = byte_order::big;
+    std::string order_text = std::string(options.get("byte_order"));
+    if (order_text != "" && !parse_byte_order(order_text, order)) {
+        std::cerr << "Error: invalid byte order \"" << order_text << "\"" << std::endl;
+        return -1;
+    }
 
     // grab the number of LEM1802's the user wants to have attached
     int num_lems = 1;
@@ -95,75 +258,328 @@ int main(int argc, char** argv)
          num_speds = (int)options.get("num_speds");
     }
 
-    // read in the binary file, create the dcpu instance, and flash it with the binary
-    std::ifstream file;
-    file.open(binary_filename, std::ios::in | std::ios::binary | std::ios::ate);
+    // grab the farm size; a farm is always headless and unthrottled
+    int farm_size = 0;
+    if (std::string(options.get("farm")) != ""){
+        farm_size = (int)options.get("farm");
+        if (farm_size < 1) {
+            std::cerr << "Error: --farm needs at least one instance" << std::endl;
+            return -1;
+        }
+        if (save_state != "") {
+            std::cerr << "Error: --save-state can't be used with --farm" << std::endl;
+            return -1;
+        }
+    }
+
+    // the debugger decides when the program runs, so there's no window loop
+    std::string gdb_address = std::string(options.get("gdb"));
+    if (gdb_address != "" && farm_size > 0) {
+        std::cerr << "Error: --gdb can't be used with --farm" << std::endl;
+        return -1;
+    }
+    bool headless = options.get("headless") || farm_size > 0 || gdb_address != "";
+
+    // input is recorded from the windows and replayed without them
+    std::string record = std::string(options.get("record"));
+    std::string replay = std::string(options.get("replay"));
+    if (record != "" && headless) {
+        std::cerr << "Error: --record needs the windows to take input from, so can't be used headless" << std::endl;
+        return -1;
+    }
+    if (replay != "" && (!options.get("headless") || farm_size > 0)) {
+        std::cerr << "Error: --replay only works with --headless" << std::endl;
+        return -1;
+    }
+
+    // the metrics cover the main loop, so there have to be windows
+    std::string metrics_target = std::string(options.get("metrics"));
+    if (metrics_target != "") {
+        if (headless) {
+            std::cerr << "Error: --metrics times the window loop, so can't be used headless" << std::endl;
+            return -1;
+        }
+        if (metrics_target != "stderr" && metrics_target.compare(0, 5, "unix:") != 0) {
+            std::cerr << "Error: invalid metrics target \"" << metrics_target << "\"" << std::endl;
+            return -1;
+        }
+    }
+
+    std::string profile_filename = std::string(options.get("profile"));
+    if (profile_filename != "" && farm_size > 0) {
+        std::cerr << "Error: --profile can't be used with --farm" << std::endl;
+        return -1;
+    }
+    if (gdb_address != "" && (profile_filename != "" || replay != "")) {
+        std::cerr << "Error: --profile and --replay can't be used with --gdb" << std::endl;
+        return -1;
+    }
+
+    // grab the speed multiplier; headless runs default to unthrottled
+    double speed = headless ? 0 : 1;
+    std::string speed_text = std::string(options.get("speed"));
+    if (speed_text != ""){
+        if (!cycle_pacer::parse_speed(speed_text, speed)) {
+            std::cerr << "Error: invalid speed \"" << speed_text << "\"" << std::endl;
+            return -1;
+        }
+    }
+
+    // grab the disk backend
+    disk_backend backend = disk_backend::fstream;
+    std::string backend_text = std::string(options.get("disk_backend"));
+    if (backend_text == "mmap") {
+        backend = disk_backend::mmap;
+    } else if (backend_text == "overlay") {
+        backend = disk_backend::overlay;
+    } else if (backend_text == "overlay-commit") {
+        backend = disk_backend::overlay_commit;
+    } else if (backend_text != "" && backend_text != "fstream") {
+        std::cerr << "Error: invalid disk backend \"" << backend_text << "\"" << std::endl;
+        return -1;
+    }
 
-    if (!file.is_open()) {
-        std::cerr << "Error: could not open file \"" << binary_filename << "\"" << std::endl;
+    // grab the cpu backend
+    cpu_backend cpu_core = cpu_backend::reference;
+    std::string cpu_text = std::string(options.get("cpu_backend"));
+    if (cpu_text != "" && !parse_cpu_backend(cpu_text, cpu_core)) {
+        std::cerr << "Error: invalid cpu backend \"" << cpu_text << "\"" << std::endl;
         return -1;
     }
 
-    int size = file.tellg();
-    char* buffer = new char[size];
-    file.seekg(0, std::ios::beg);
-    file.read(buffer, size);
-    file.close();
+    // a snapshot refers to the disk images rather than holding their contents,
+    // and a plain overlay throws away everything written to them at exit
+    if (save_state != "" && backend == disk_backend::overlay) {
+        std::cerr << "Error: --save-state can't keep what was written to an overlay disk; use --disk-backend=overlay-commit or another backend" << std::endl;
+        return -1;
+    }
 
-    galaxy::saturn::dcpu cpu;
-    // TODO: FIX: use cpu.flash()
-    for (int i = 0; i < (size / 2) && i < cpu.ram.size(); i++) {
-        cpu.ram[i] = (buffer[i * 2]) << 0x8;
-        cpu.ram[i] ^= buffer[i * 2 + 1] & 0xff;
+    // the instances of a farm share their disk images, so none of them may write to them
+    if (farm_size > 0) {
+        if (backend_text != "" && backend != disk_backend::overlay) {
+            std::cerr << "Error: --farm shares disk images between instances, so needs --disk-backend=overlay" << std::endl;
+            return -1;
+        }
+        backend = disk_backend::overlay;
     }
 
-    delete[] buffer;
+    // a snapshot brings its own devices along
+    snapshot state;
+    std::list<std::string> disk_filenames = options.all("disk_image_filename");
+    if (load_state != "") {
+        if (!state.load(load_state))
+            return -1;
+        num_lems = state.num_lems;
+        num_speds = state.num_speds;
+        disk_filenames = state.disk_filenames;
+    }
 
     // setup the floppy disks
-    if (options.all("disk_image_filename").size() != 0){
-        // we start by grabbing a list of floppy names, and tell the user how many we are loading
-        std::list<std::string> filenames = options.all("disk_image_filename");
-        std::cout << "Loading " << filenames.size() << " floppy disks" << std::endl;
+    if (!disk_filenames.empty())
+        std::cout << "Loading " << disk_filenames.size() << " floppy disks" << std::endl;
+
+    // create the dcpu and its devices, and flash it with the binary or snapshot
+    std::unique_ptr<machine> created;
+    try {
+        created.reset(new machine(num_lems, num_speds, disk_filenames, backend, cpu_core));
+    } catch(std::runtime_error& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return -1;
+    }
+    machine& m = *created;
+    m.fast_forward = !options.get("no_fast_forward");
+    m.let_devices_sleep(options.get("sleep_devices"));
+
+    if (load_state != "") {
+        state.restore(m);
+    } else {
+        for (auto it = segments.begin(); it != segments.end(); ++it) {
+            if (!load_binary(m.cpu, it->filename, it->address, order))
+                return -1;
+        }
+    }
+
+    for (auto it = exit_pcs.begin(); it != exit_pcs.end(); ++it)
+        m.set_breakpoint(*it, true);
+    for (auto it = exit_writes.begin(); it != exit_writes.end(); ++it)
+        m.set_watchpoint(*it, true);
+
+    // snapshots need to know how the program set its devices up
+    if (save_state != "" || load_state != "")
+        m.watch_hwi = true;
+
+    // the profile is written out however the run ends
+    std::unique_ptr<profiler> profile;
+    if (profile_filename != "") {
+        profile.reset(new profiler(m));
+        std::string symbols = std::string(options.get("symbols"));
+        if (symbols != "" && !profile->load_symbols(symbols))
+            return -1;
+    }
 
-        // thence we iterate through, using my handy helper function attach_m35fd
-        for (std::list<std::string>::iterator i = filenames.begin(); i != filenames.end(); i++) {
-            attach_m35fd(cpu, *i);
+    if (headless) {
+        std::uint64_t max_cycles = 0;
+        if (std::string(options.get("max_cycles")) != "")
+            max_cycles = (long)options.get("max_cycles");
+
+        double time_limit = 0;
+        if (std::string(options.get("time_limit")) != "")
+            time_limit = (double)options.get("time_limit");
+
+        if (farm_size > 0) {
+            std::size_t threads = 0;
+            if (std::string(options.get("threads")) != "")
+                threads = (int)options.get("threads");
+
+            // the program is read once, into the first instance, and the rest
+            // start from a copy of its memory (or from the same snapshot)
+            farm instances (threads);
+            instances.add(std::move(created));
+            for (int i = 1; i < farm_size; i++) {
+                std::unique_ptr<machine> instance;
+                try {
+                    instance.reset(new machine(num_lems, num_speds, disk_filenames, backend, cpu_core));
+                } catch(std::runtime_error& e) {
+                    std::cerr << "Error: " << e.what() << std::endl;
+                    return -1;
+                }
+                instance->fast_forward = m.fast_forward;
+                instance->let_devices_sleep(options.get("sleep_devices"));
+                for (auto it = exit_pcs.begin(); it != exit_pcs.end(); ++it)
+                    instance->set_breakpoint(*it, true);
+                for (auto it = exit_writes.begin(); it != exit_writes.end(); ++it)
+                    instance->set_watchpoint(*it, true);
+                if (load_state != "")
+                    state.restore(*instance);
+                else
+                    instance->cpu.ram = m.cpu.ram;
+                instances.add(std::move(instance));
+            }
+            return instances.run(max_cycles, time_limit, stop_expected);
+        }
+
+        int status;
+        if (gdb_address != "") {
+            gdb_stub stub (m);
+            if (!stub.listen(gdb_address))
+                return -1;
+            status = stub.run();
+        } else {
+            input_log replay_log;
+            if (replay != "" && !replay_log.load(replay))
+                return -1;
+
+            status = run_headless(m, max_cycles, time_limit, speed, replay != "" ? &replay_log : 0, profile.get(), stop_expected);
+        }
+
+        if (profile && !profile->write(profile_filename))
+            return -1;
+
+        if (save_state != "") {
+            if (!state.capture(m) || !state.save(save_state))
+                return -1;
         }
+
+        return status;
+    }
+
+    // the keyboard is fed from all of the windows
+    keyboard_adaptor keyboard (*m.keyboard);
+
+    input_log record_log;
+    if (record != "") {
+        if (!record_log.create(record))
+            return -1;
+        keyboard.record_to(&record_log);
+    }
+
+    // the LEM1802 screens can be drawn by a shader, if the driver has them
+    bool lem_shader = false;
+    if (options.get("lem_shader")) {
+        lem_shader = sf::Shader::isAvailable();
+        if (!lem_shader)
+            std::cerr << "Warning: shaders are not available, drawing LEM1802 screens on the CPU" << std::endl;
     }
 
+    // everything timed has to be registered before the emulation thread starts
+    std::unique_ptr<metrics> stats;
+    if (metrics_target != "")
+        stats.reset(new metrics());
+
+    // from here on the cpu runs on its own thread; the windows only see what it publishes
+    emulation_thread emulation (m, keyboard, speed, options.get("show_rate"), lem_shader, profile.get(), stats.get());
+
     // create the LEM1802 windows
     std::vector<std::unique_ptr<LEM1802Window>> lem_windows;
-    for (int i = 0; i < num_lems; i++) {
-        std::unique_ptr<LEM1802Window> win (new LEM1802Window(static_cast<galaxy::saturn::lem1802&>(cpu.attach_device(new galaxy::saturn::lem1802()))));
+    for (std::size_t i = 0; i < m.lems.size(); i++) {
+        std::unique_ptr<LEM1802Window> win (new LEM1802Window(emulation.lem_frames(i), lem_shader));
         lem_windows.push_back(std::move(win));
     }
 
-    // create the LEM1802 windows
+    // every screen gets the same kind of frame, so if one window couldn't
+    // compile its shader, they all draw on the CPU
+    bool compiled = true;
+    for (std::size_t i = 0; i < lem_windows.size(); i++)
+        compiled = compiled && lem_windows[i]->uses_shader();
+    if (lem_shader && !compiled) {
+        std::cerr << "Warning: the LEM1802 shader didn't compile, drawing LEM1802 screens on the CPU" << std::endl;
+        for (std::size_t i = 0; i < lem_windows.size(); i++)
+            lem_windows[i]->draw_on_cpu();
+        emulation.publish_pixels();
+    }
+
+    // create the SPED-3 windows
     std::vector<std::unique_ptr<SPED3Window>> sped_windows;
-    for (int i = 0; i < num_speds; i++) {
-        std::unique_ptr<SPED3Window> win (new SPED3Window(static_cast<galaxy::saturn::sped3&>(cpu.attach_device(new galaxy::saturn::sped3()))));
+    for (std::size_t i = 0; i < m.speds.size(); i++) {
+        std::unique_ptr<SPED3Window> win (new SPED3Window(emulation.sped_frames(i)));
         sped_windows.push_back(std::move(win));
     }
 
-    // attach the clock
-    cpu.attach_device(new galaxy::saturn::clock());
-
-    // attack the keyboard
-    keyboard_adaptor keyboard (static_cast<galaxy::saturn::keyboard&>(cpu.attach_device(new galaxy::saturn::keyboard())));
+    // with no metrics, every phase is null and times nothing
+    metrics::phase* events_phase = 0;
+    metrics::phase* present_phase = 0;
+    std::vector<metrics::phase*> lem_phases (lem_windows.size(), 0);
+    std::vector<metrics::phase*> sped_phases (sped_windows.size(), 0);
+    metrics::histogram* frame_times = 0;
+    double metrics_interval = 10;
+    if (stats) {
+        events_phase = stats->add_phase("events");
+        for (std::size_t i = 0; i < lem_windows.size(); i++)
+            lem_phases[i] = stats->add_phase("render", "window=\"lem1802 " + std::to_string(i) + "\"");
+        for (std::size_t i = 0; i < sped_windows.size(); i++)
+            sped_phases[i] = stats->add_phase("render", "window=\"sped3 " + std::to_string(i) + "\"");
+        present_phase = stats->add_phase("present");
+        frame_times = stats->add_histogram("saturn_frame_seconds", "Host time between presented frames.",
+            {0.001, 0.002, 0.004, 0.008, 0.016, 0.033, 0.066, 0.133, 0.25, 0.5, 1});
+
+        if (std::string(options.get("metrics_interval")) != "")
+            metrics_interval = (double)options.get("metrics_interval");
+        if (metrics_target != "stderr" && !stats->serve(metrics_target.substr(5)))
+            return -1;
+    }
+    std::chrono::steady_clock::time_point last_present = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point next_dump = last_present + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(metrics_interval));
 
-    // initialise the timing clock
-    sf::Clock clock;
+    emulation.start();
 
     bool running = true;
 
-    // start the main loop
-    while (running)
+    // the windows drawn to this time round, to be displayed together
+    std::vector<sf::Window*> redrawn;
+
+    // start the main loop; it stops when a window is closed or the program crashes
+    while (running && emulation.running())
     {
+        phase_timer events_timer (events_phase);
+
         // we check for events on each window
         for (auto it = lem_windows.begin(); it != lem_windows.end(); ++it) {
             sf::Event event;
             while ((*it)->pollEvent(event))
             {
+                // whatever happened to the window, make sure it gets redrawn
+                (*it)->invalidate();
+
                 if (event.type == sf::Event::Closed)
                     running = false;
                 else if (event.type == sf::Event::TextEntered)
@@ -179,6 +595,9 @@ int main(int argc, char** argv)
             sf::Event event;
             while ((*it)->pollEvent(event))
             {
+                // whatever happened to the window, make sure it gets redrawn
+                (*it)->invalidate();
+
                 if (event.type == sf::Event::Closed)
                     running = false;
                 else if (event.type == sf::Event::Resized)
@@ -190,32 +609,60 @@ int main(int argc, char** argv)
                 else if (event.type == sf::Event::KeyReleased)
                     keyboard.key_release(event.key);
             }
-            (*it)->spinS();
         }
 
-        // and compute however many cycles we must perform to keep in time
-        try {
-            sf::Int32 msec = clock.restart().asMilliseconds();
-            int cycles = (cpu.clock_speed / 1000) * msec;
-            //std::cout << "Executing " << std::dec << cycles << " cycles." << std::endl;
-            while (cycles > 0) {
-                cpu.cycle();
-                cycles--;
-            }
-        } catch(galaxy::saturn::invalid_opcode& e) {
-            std::cerr << "Error: invalid opcode: 0x" << std::hex << cpu.ram[cpu.PC] << " at 0x" << std::hex << cpu.PC << std::endl;
-            running = false;
+        events_timer.stop();
+
+        // update all the windows with their appropriate contents; LEM1802
+        // windows with nothing new to show skip redrawing entirely
+        redrawn.clear();
+        for (std::size_t i = 0; i < lem_windows.size(); i++) {
+            phase_timer timer (lem_phases[i]);
+            if (lem_windows[i]->update())
+                redrawn.push_back(lem_windows[i].get());
+        }
+
+        // update all the windows with their appropriate contents; likewise
+        // for SPED-3 windows that are neither changing nor turning
+        for (std::size_t i = 0; i < sped_windows.size(); i++) {
+            phase_timer timer (sped_phases[i]);
+            if (sped_windows[i]->update())
+                redrawn.push_back(sped_windows[i].get());
+        }
+
+        if (!redrawn.empty()) {
+            phase_timer timer (present_phase);
+            for (auto it = redrawn.begin(); it != redrawn.end(); ++it)
+                (*it)->display();
+        }
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (frame_times && !redrawn.empty()) {
+            frame_times->observe(std::chrono::duration<double>(now - last_present).count());
+            last_present = now;
+        }
+        if (stats && metrics_target == "stderr" && now >= next_dump) {
+            std::cerr << stats->format();
+            next_dump = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(metrics_interval));
         }
 
-        // update all the windows with their appropriate contents
-        for (auto it = lem_windows.begin(); it != lem_windows.end(); ++it)
-            (*it)->update();
+        // with no vsync'd display to wait on, don't spin
+        if (redrawn.empty())
+            sf::sleep(sf::milliseconds(1));
+    }
+
+    emulation.stop();
+
+    if (stats && metrics_target == "stderr")
+        std::cerr << stats->format();
 
-        // update all the windows with their appropriate contents
-        for (auto it = sped_windows.begin(); it != sped_windows.end(); ++it)
-            (*it)->update();
+    if (profile && !profile->write(profile_filename))
+        return -1;
 
+    if (save_state != "") {
+        if (!state.capture(m) || !state.save(save_state))
+            return -1;
     }
 
-    return 0;
+    return emulation.exit_status();
 }
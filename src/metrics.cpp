@@ -0,0 +1,199 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#include "metrics.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+void metrics::histogram::observe(double value)
+{
+    for (std::size_t i = 0; i < bounds.size(); i++) {
+        if (value <= bounds[i]) {
+            buckets[i].fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+    }
+    // only ever written from one thread, so this needn't be a compare-exchange
+    sum.store(sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+}
+
+metrics::metrics() : cycles_total(0), socket_fd(-1), stop_requested(false)
+{
+}
+
+metrics::~metrics()
+{
+    stop_requested = true;
+    if (listener.joinable())
+        listener.join();
+    if (socket_fd >= 0) {
+        close(socket_fd);
+        unlink(socket_path.c_str());
+    }
+}
+
+metrics::phase* metrics::add_phase(const std::string& name, const std::string& labels)
+{
+    std::unique_ptr<phase> p (new phase());
+    p->name = name;
+    p->labels = labels;
+    p->calls = 0;
+    p->nanoseconds = 0;
+    phases.push_back(std::move(p));
+    return phases.back().get();
+}
+
+metrics::histogram* metrics::add_histogram(const std::string& name, const std::string& help, const std::vector<double>& bounds)
+{
+    std::unique_ptr<histogram> h (new histogram());
+    h->name = name;
+    h->help = help;
+    h->bounds = bounds;
+    h->buckets.reset(new std::atomic<std::uint64_t>[bounds.size()]);
+    for (std::size_t i = 0; i < bounds.size(); i++)
+        h->buckets[i] = 0;
+    h->count = 0;
+    h->sum = 0;
+    histograms.push_back(std::move(h));
+    return histograms.back().get();
+}
+
+std::string metrics::format() const
+{
+    std::ostringstream out;
+
+    out << "# HELP saturn_cycles_total DCPU cycles executed." << "\n";
+    out << "# TYPE saturn_cycles_total counter" << "\n";
+    out << "saturn_cycles_total " << cycles_total.load(std::memory_order_relaxed) << "\n";
+
+    out << "# HELP saturn_phase_seconds_total Host time spent in each phase of the main and emulation loops." << "\n";
+    out << "# TYPE saturn_phase_seconds_total counter" << "\n";
+    for (std::size_t i = 0; i < phases.size(); i++) {
+        const phase& p = *phases[i];
+        out << "saturn_phase_seconds_total{phase=\"" << p.name << "\"" << (p.labels.empty() ? "" : ",") << p.labels << "} "
+            << p.nanoseconds.load(std::memory_order_relaxed) / 1e9 << "\n";
+    }
+
+    out << "# HELP saturn_phase_calls_total Times each phase of the main and emulation loops ran." << "\n";
+    out << "# TYPE saturn_phase_calls_total counter" << "\n";
+    for (std::size_t i = 0; i < phases.size(); i++) {
+        const phase& p = *phases[i];
+        out << "saturn_phase_calls_total{phase=\"" << p.name << "\"" << (p.labels.empty() ? "" : ",") << p.labels << "} "
+            << p.calls.load(std::memory_order_relaxed) << "\n";
+    }
+
+    // buckets are counted individually, but the format wants them cumulative
+    for (std::size_t i = 0; i < histograms.size(); i++) {
+        const histogram& h = *histograms[i];
+        out << "# HELP " << h.name << " " << h.help << "\n";
+        out << "# TYPE " << h.name << " histogram" << "\n";
+        std::uint64_t cumulative = 0;
+        for (std::size_t b = 0; b < h.bounds.size(); b++) {
+            cumulative += h.buckets[b].load(std::memory_order_relaxed);
+            out << h.name << "_bucket{le=\"" << h.bounds[b] << "\"} " << cumulative << "\n";
+        }
+        std::uint64_t count = h.count.load(std::memory_order_relaxed);
+        out << h.name << "_bucket{le=\"+Inf\"} " << count << "\n";
+        out << h.name << "_sum " << h.sum.load(std::memory_order_relaxed) << "\n";
+        out << h.name << "_count " << count << "\n";
+    }
+
+    return out.str();
+}
+
+bool metrics::serve(const std::string& path)
+{
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Error: socket path \"" << path << "\" is too long" << std::endl;
+        return false;
+    }
+    std::strcpy(address.sun_path, path.c_str());
+
+    socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socket_fd < 0) {
+        std::cerr << "Error: could not create socket: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    // a socket left behind by an earlier run would stop us binding
+    unlink(path.c_str());
+    if (bind(socket_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(socket_fd, 4) != 0) {
+        std::cerr << "Error: could not listen on \"" << path << "\": " << std::strerror(errno) << std::endl;
+        close(socket_fd);
+        socket_fd = -1;
+        return false;
+    }
+
+    socket_path = path;
+    listener = std::thread(&metrics::listen, this);
+    return true;
+}
+
+void metrics::listen()
+{
+    while (!stop_requested.load(std::memory_order_relaxed)) {
+        // wake up now and then to see whether we should stop
+        pollfd waiting = { socket_fd, POLLIN, 0 };
+        if (poll(&waiting, 1, 200) <= 0)
+            continue;
+
+        int client = accept(socket_fd, 0, 0);
+        if (client < 0)
+            continue;
+
+        // whatever was asked for, briefly give the client a chance to send
+        // its request so that closing doesn't reset the connection under it
+        pollfd request = { client, POLLIN, 0 };
+        if (poll(&request, 1, 100) > 0) {
+            char discard[1024];
+            ssize_t ignored = recv(client, discard, sizeof(discard), MSG_DONTWAIT);
+            (void)ignored;
+        }
+
+        std::string body = format();
+        std::ostringstream response;
+        response << "HTTP/1.0 200 OK\r\n"
+                 << "Content-Type: text/plain; version=0.0.4\r\n"
+                 << "Content-Length: " << body.size() << "\r\n\r\n"
+                 << body;
+        std::string text = response.str();
+        for (std::size_t sent = 0; sent < text.size(); ) {
+            ssize_t n = send(client, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0)
+                break;
+            sent += n;
+        }
+        close(client);
+    }
+}
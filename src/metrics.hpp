@@ -0,0 +1,122 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// timing counters and histograms for the host side of the emulator, written
+/// out in the Prometheus text format. everything is registered up front, before
+/// any thread starts updating it; after that, each phase or histogram is
+/// updated from one thread while any other thread may read it
+class metrics {
+    public:
+        /// a phase of a loop: how often it ran and the host time it took
+        struct phase {
+            std::string name;
+            std::string labels;
+            std::atomic<std::uint64_t> calls;
+            std::atomic<std::uint64_t> nanoseconds;
+        };
+
+        /// a histogram with fixed bucket bounds; observations above the last
+        /// bound only count towards +Inf
+        struct histogram {
+            std::string name;
+            std::string help;
+            std::vector<double> bounds;
+            std::unique_ptr<std::atomic<std::uint64_t>[]> buckets;
+            std::atomic<std::uint64_t> count;
+            std::atomic<double> sum;
+
+            void observe(double value);
+        };
+
+        metrics();
+        ~metrics();
+
+        /// labels are written as they are, e.g. window="lem1802 0"
+        phase* add_phase(const std::string& name, const std::string& labels = "");
+        histogram* add_histogram(const std::string& name, const std::string& help, const std::vector<double>& bounds);
+
+        /// counts cycles executed, alongside the phases
+        void add_cycles(std::uint64_t cycles) { cycles_total.fetch_add(cycles, std::memory_order_relaxed); }
+
+        /// everything, in the Prometheus text format
+        std::string format() const;
+
+        /// answers every connection to a UNIX socket at path with format(),
+        /// as an HTTP response, from a thread of its own. returns false (having
+        /// printed why) if the socket couldn't be set up
+        bool serve(const std::string& path);
+    private:
+        void listen();
+
+        std::vector<std::unique_ptr<phase>> phases;
+        std::vector<std::unique_ptr<histogram>> histograms;
+        std::atomic<std::uint64_t> cycles_total;
+
+        std::string socket_path;
+        int socket_fd;
+        std::thread listener;
+        std::atomic<bool> stop_requested;
+
+        metrics(const metrics&);
+        metrics& operator=(const metrics&);
+};
+
+/// times the enclosing scope (or until stop()) into a phase; a null phase
+/// times nothing, so code can be instrumented unconditionally at the cost of
+/// a branch
+class phase_timer {
+    public:
+        phase_timer(metrics::phase* p) : p(p)
+        {
+            if (p)
+                start = std::chrono::steady_clock::now();
+        }
+
+        ~phase_timer() { stop(); }
+
+        /// ends the phase before the scope does
+        void stop()
+        {
+            if (!p)
+                return;
+            std::chrono::nanoseconds elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+            p->calls.fetch_add(1, std::memory_order_relaxed);
+            p->nanoseconds.fetch_add(elapsed.count(), std::memory_order_relaxed);
+            p = 0;
+        }
+    private:
+        metrics::phase* p;
+        std::chrono::steady_clock::time_point start;
+};
+
+#endif
@@ -0,0 +1,135 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#include "mmap_disk.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <endian.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+mmap_disk::mmap_disk(const std::string& filename, bool open_read_only) : filename(filename), fd(-1), image(0), mapped_size(0), read_only(open_read_only)
+{
+    if (!read_only)
+        fd = open(filename.c_str(), O_RDWR);
+    if (read_only || (fd < 0 && (errno == EACCES || errno == EROFS))) {
+        fd = open(filename.c_str(), O_RDONLY);
+        read_only = true;
+    }
+    if (fd < 0)
+        throw std::runtime_error("could not open disk image \"" + filename + "\": " + std::strerror(errno));
+
+    // only the image as it is gets mapped, so a short one is never grown by
+    // opening it; sectors past its end read as zeroes until one is written
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        std::string reason = std::strerror(errno);
+        close(fd);
+        throw std::runtime_error("could not size disk image \"" + filename + "\": " + reason);
+    }
+    mapped_size = image_size;
+    if (static_cast<std::size_t>(info.st_size) < image_size)
+        mapped_size = info.st_size;
+
+    // an empty image has nothing to map, and mmap won't take a length of zero
+    if (mapped_size == 0)
+        return;
+    void* mapping = mmap(0, mapped_size, read_only ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        std::string reason = std::strerror(errno);
+        close(fd);
+        throw std::runtime_error("could not map disk image \"" + filename + "\": " + reason);
+    }
+    image = static_cast<unsigned char*>(mapping);
+}
+
+mmap_disk::~mmap_disk()
+{
+    flush();
+    if (image)
+        munmap(image, mapped_size);
+    close(fd);
+}
+
+void mmap_disk::read_sector(std::uint16_t sector, std::uint16_t* buffer)
+{
+    if (sector >= sectors)
+        return;
+
+    // a straight copy, then swapping each word from big-endian in place; the
+    // mapping of a short image ends with the file, so stay inside it
+    std::size_t offset = sector * sector_words * 2;
+    std::size_t available = offset < mapped_size ? std::min(mapped_size - offset, sector_words * 2) : 0;
+    if (available > 0)
+        std::memcpy(buffer, image + offset, available);
+    std::memset(reinterpret_cast<unsigned char*>(buffer) + available, 0, sector_words * 2 - available);
+    for (std::size_t i = 0; i < sector_words; i++)
+        buffer[i] = be16toh(buffer[i]);
+}
+
+void mmap_disk::write_sector(std::uint16_t sector, const std::uint16_t* buffer)
+{
+    if (sector >= sectors || read_only)
+        return;
+
+    std::size_t offset = sector * sector_words * 2;
+    if (offset + sector_words * 2 > mapped_size && !grow())
+        return;
+
+    std::uint16_t* out = reinterpret_cast<std::uint16_t*>(image + offset);
+    for (std::size_t i = 0; i < sector_words; i++)
+        out[i] = htobe16(buffer[i]);
+}
+
+bool mmap_disk::grow()
+{
+    if (ftruncate(fd, image_size) != 0) {
+        std::cerr << "Error: could not grow disk image \"" << filename << "\": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    // the old mapping is of the same file, so there's nothing in it that the
+    // new one won't see
+    void* mapping = mmap(0, image_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Error: could not map disk image \"" << filename << "\": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    if (image)
+        munmap(image, mapped_size);
+    image = static_cast<unsigned char*>(mapping);
+    mapped_size = image_size;
+    return true;
+}
+
+void mmap_disk::flush()
+{
+    if (!read_only && image)
+        msync(image, mapped_size, MS_SYNC);
+}
@@ -0,0 +1,72 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#ifndef MMAP_DISK_HPP
+#define MMAP_DISK_HPP
+
+#include <libsaturn.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/// a floppy image mapped into memory once, instead of going through an
+/// fstream for every sector. the image uses the same layout as fstream_disk
+/// (big-endian words, sector after sector), so images work with either.
+/// changes are written back with msync when the disk is ejected or destroyed;
+/// a read-only image (or one opened with read_only) makes a write protected
+/// disk. an image shorter than a full disk is left that size until something
+/// is written past its end, which grows it to a full disk as writing through
+/// a stream would; until then, and for good if it's read-only, the sectors
+/// past its end read as zeroes. throws std::runtime_error if the image can't
+/// be opened or mapped
+class mmap_disk : public galaxy::saturn::disk {
+    public:
+        static const std::size_t sector_words = 512;
+        static const std::size_t sectors = 1440;
+        static const std::size_t image_size = sector_words * sectors * 2;
+
+        mmap_disk(const std::string& filename, bool read_only = false);
+        ~mmap_disk();
+
+        void read_sector(std::uint16_t sector, std::uint16_t* buffer);
+        void write_sector(std::uint16_t sector, const std::uint16_t* buffer);
+        bool is_write_protected() const { return read_only; }
+
+        /// writes any changes back to the image file
+        void flush();
+    private:
+        /// grows a short image to a full disk and maps all of it, saying why
+        /// on std::cerr if it can't
+        bool grow();
+
+        std::string filename;
+        int fd;
+        unsigned char* image;
+        std::size_t mapped_size;
+        bool read_only;
+
+        mmap_disk(const mmap_disk&);
+        mmap_disk& operator=(const mmap_disk&);
+};
+
+#endif
@@ -0,0 +1,104 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#include "overlay_disk.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <endian.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+overlay_disk::overlay_disk(const std::string& filename, bool commit_on_exit) : filename(filename), base(filename, true),
+    overlay(mmap_disk::sectors), used(0), commit_on_exit(commit_on_exit)
+{
+}
+
+overlay_disk::~overlay_disk()
+{
+    if (commit_on_exit)
+        commit();
+}
+
+void overlay_disk::read_sector(std::uint16_t sector, std::uint16_t* buffer)
+{
+    if (sector >= mmap_disk::sectors)
+        return;
+
+    if (overlay[sector])
+        std::memcpy(buffer, overlay[sector]->data(), mmap_disk::sector_words * 2);
+    else
+        base.read_sector(sector, buffer);
+}
+
+void overlay_disk::write_sector(std::uint16_t sector, const std::uint16_t* buffer)
+{
+    if (sector >= mmap_disk::sectors)
+        return;
+
+    // sectors are always written whole, so nothing needs copying out of the
+    // image the first time
+    if (!overlay[sector]) {
+        overlay[sector].reset(new sector_data());
+        used++;
+    }
+    std::memcpy(overlay[sector]->data(), buffer, mmap_disk::sector_words * 2);
+}
+
+bool overlay_disk::commit()
+{
+    if (used == 0)
+        return true;
+
+    int fd = open(filename.c_str(), O_WRONLY);
+    if (fd < 0) {
+        std::cerr << "Error: could not commit disk image \"" << filename << "\": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    // only written sectors go back, swapped to big-endian on the way; the
+    // read-only mapping of the image sees them through the page cache
+    sector_data out;
+    for (std::size_t sector = 0; sector < mmap_disk::sectors; sector++) {
+        if (!overlay[sector])
+            continue;
+        for (std::size_t i = 0; i < mmap_disk::sector_words; i++)
+            out[i] = htobe16((*overlay[sector])[i]);
+        off_t offset = sector * mmap_disk::sector_words * 2;
+        if (pwrite(fd, out.data(), mmap_disk::sector_words * 2, offset) != static_cast<ssize_t>(mmap_disk::sector_words * 2)) {
+            std::cerr << "Error: could not commit disk image \"" << filename << "\": " << std::strerror(errno) << std::endl;
+            close(fd);
+            return false;
+        }
+    }
+    close(fd);
+    return true;
+}
+
+void overlay_disk::discard()
+{
+    for (std::size_t sector = 0; sector < mmap_disk::sectors; sector++)
+        overlay[sector].reset();
+    used = 0;
+}
@@ -0,0 +1,71 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#ifndef OVERLAY_DISK_HPP
+#define OVERLAY_DISK_HPP
+
+#include "mmap_disk.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/// a copy-on-write floppy: the image is mapped read-only and shared, and
+/// sectors the program writes are kept in memory on top of it. the overlay is
+/// thrown away when the disk is destroyed, unless commit_on_exit is set, in
+/// which case only the written sectors are stored back into the image.
+/// throws std::runtime_error if the image can't be opened or mapped
+class overlay_disk : public galaxy::saturn::disk {
+    public:
+        overlay_disk(const std::string& filename, bool commit_on_exit = false);
+        ~overlay_disk();
+
+        void read_sector(std::uint16_t sector, std::uint16_t* buffer);
+        void write_sector(std::uint16_t sector, const std::uint16_t* buffer);
+        bool is_write_protected() const { return false; }
+
+        /// number of sectors held in the overlay
+        std::size_t overlay_sectors() const { return used; }
+
+        /// writes the overlay back into the image. the overlay itself is kept,
+        /// so reads are unaffected. returns false (having printed why) if the
+        /// image couldn't be written
+        bool commit();
+        /// forgets everything written, going back to the image's contents
+        void discard();
+    private:
+        typedef std::array<std::uint16_t, mmap_disk::sector_words> sector_data;
+
+        std::string filename;
+        mmap_disk base;
+        std::vector<std::unique_ptr<sector_data>> overlay;
+        std::size_t used;
+        bool commit_on_exit;
+
+        overlay_disk(const overlay_disk&);
+        overlay_disk& operator=(const overlay_disk&);
+};
+
+#endif
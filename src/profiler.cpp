@@ -0,0 +1,320 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#include "profiler.hpp"
+#include "loader.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace {
+    const char* const basic_names[0x20] = {
+        0, "SET", "ADD", "SUB", "MUL", "MLI", "DIV", "DVI",
+        "MOD", "MDI", "AND", "BOR", "XOR", "SHR", "ASR", "SHL",
+        "IFB", "IFC", "IFE", "IFN", "IFG", "IFA", "IFL", "IFU",
+        0, 0, "ADX", "SBX", 0, 0, "STI", "STD"
+    };
+
+    const char* const special_names[0x20] = {
+        0, "JSR", 0, 0, 0, 0, 0, 0,
+        "INT", "IAG", "IAS", "RFI", "IAQ", 0, 0, 0,
+        "HWN", "HWQ", "HWI", 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0
+    };
+
+    // base costs from the spec, before operand words and failed conditionals
+    const std::uint8_t basic_cycles[0x20] = {
+        0, 1, 2, 2, 2, 2, 3, 3, 3, 3, 1, 1, 1, 1, 1, 1,
+        2, 2, 2, 2, 2, 2, 2, 2, 0, 0, 3, 3, 0, 0, 2, 2
+    };
+
+    const std::uint8_t special_cycles[0x20] = {
+        0, 3, 0, 0, 0, 0, 0, 0, 4, 1, 1, 3, 2, 0, 0, 0,
+        2, 4, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+    };
+
+    /// SET PC, POP: how DCPU code returns from a JSR
+    const std::uint16_t return_word = (instruction::PUSH_POP << 10) | (instruction::PC << 5) | instruction::SET;
+}
+
+profiler::profiler(const machine& m) : addresses(0x10000), opcodes(), current(0), depth(0), ignored(0)
+{
+    // name the devices after their kind and their index among that kind
+    for (std::size_t i = 0; i < m.devices.size(); i++) {
+        const galaxy::saturn::device* device = m.devices[i];
+        std::ostringstream name;
+        if (std::find(m.drives.begin(), m.drives.end(), device) != m.drives.end())
+            name << "m35fd " << std::find(m.drives.begin(), m.drives.end(), device) - m.drives.begin();
+        else if (std::find(m.lems.begin(), m.lems.end(), device) != m.lems.end())
+            name << "lem1802 " << std::find(m.lems.begin(), m.lems.end(), device) - m.lems.begin();
+        else if (std::find(m.speds.begin(), m.speds.end(), device) != m.speds.end())
+            name << "sped3 " << std::find(m.speds.begin(), m.speds.end(), device) - m.speds.begin();
+        else if (device == m.clock)
+            name << "clock";
+        else if (device == m.keyboard)
+            name << "keyboard";
+        else
+            name << "device " << i;
+        device_names.push_back(name.str());
+    }
+    devices.resize(m.devices.size(), device_time());
+
+    // the root of the call tree is wherever the program was when we started
+    frame root;
+    root.key = m.cpu.PC;
+    root.parent = 0;
+    root.cycles = 0;
+    frames.push_back(root);
+}
+
+void profiler::cycle(machine& m)
+{
+    galaxy::saturn::dcpu& cpu = m.cpu;
+    instruction ins = decode(cpu.ram, cpu.PC);
+    std::uint16_t word = cpu.ram[ins.address];
+    std::uint16_t interrupt_address = cpu.IA;
+
+    if (ins.is_special() && ins.special == instruction::HWI) {
+        // the device index has to be read before the HWI changes anything
+        std::uint16_t index = peek_operand(cpu, ins.a, ins.next_a);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        m.cycle();
+        if (index < devices.size()) {
+            devices[index].interrupts++;
+            devices[index].time += std::chrono::steady_clock::now() - start;
+        }
+    } else {
+        m.cycle();
+    }
+
+    std::uint64_t cost = ins.is_special() ? special_cycles[ins.special] : basic_cycles[ins.opcode];
+    cost += instruction::has_next_word(ins.a) + (!ins.is_special() && instruction::has_next_word(ins.b));
+
+    // a conditional that failed skipped at least one instruction, costing one more
+    std::uint16_t fallthrough = ins.address + ins.length;
+    if (ins.is_conditional() && cpu.PC != fallthrough)
+        cost++;
+
+    counts& at = addresses[ins.address];
+    at.instructions++;
+    at.cycles += cost;
+    counts& op = opcodes[ins.is_special() ? 0x20 + ins.special : ins.opcode];
+    op.instructions++;
+    op.cycles += cost;
+    frames[current].cycles += cost;
+
+    // follow the call tree; an interrupt shows up as PC landing on IA when
+    // the instruction itself wouldn't have taken it there
+    if (ins.is_special() && ins.special == instruction::JSR) {
+        enter(cpu.PC);
+    } else if (word == return_word) {
+        leave(false);
+    } else if (ins.is_special() && ins.special == instruction::RFI) {
+        leave(true);
+    } else if (interrupt_address != 0 && cpu.PC == interrupt_address && cpu.PC != fallthrough && !(ins.opcode == instruction::SET && ins.b == instruction::PC)) {
+        enter(interrupt_frame + interrupt_address);
+    }
+}
+
+void profiler::enter(std::uint32_t key)
+{
+    // code that JSRs without ever returning would grow the tree forever, so
+    // past the limit frames are only counted, for leave() to use up first
+    if (depth >= max_depth) {
+        if (key >= interrupt_frame)
+            ignored_interrupts.push_back(ignored);
+        ignored++;
+        return;
+    }
+
+    frame& parent = frames[current];
+    std::map<std::uint32_t, std::size_t>::iterator child = parent.children.find(key);
+    if (child != parent.children.end()) {
+        current = child->second;
+    } else {
+        frame f;
+        f.key = key;
+        f.parent = current;
+        f.cycles = 0;
+        frames.push_back(f);
+        current = frames.size() - 1;
+        frames[frames[current].parent].children[key] = current;
+    }
+    depth++;
+}
+
+void profiler::leave(bool interrupt)
+{
+    if (ignored > 0) {
+        if (!interrupt) {
+            ignored--;
+            return;
+        }
+        if (!ignored_interrupts.empty()) {
+            ignored = ignored_interrupts.back();
+            ignored_interrupts.pop_back();
+            return;
+        }
+        // the interrupt arrived below the limit, in a frame that's in the tree
+        ignored = 0;
+    }
+
+    // RFI unwinds to the frame the interrupt arrived in, whatever the handler called
+    while (depth > 0) {
+        bool was_interrupt = frames[current].key >= interrupt_frame;
+        current = frames[current].parent;
+        depth--;
+        if (!interrupt || was_interrupt)
+            break;
+    }
+}
+
+bool profiler::load_symbols(const std::string& filename)
+{
+    std::ifstream in(filename);
+    if (!in.is_open()) {
+        std::cerr << "Error: could not open file \"" << filename << "\"" << std::endl;
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(in, line)) {
+        std::replace(line.begin(), line.end(), ':', ' ');
+        std::replace(line.begin(), line.end(), '=', ' ');
+
+        std::istringstream fields(line);
+        std::string first, second, rest;
+        if (!(fields >> first >> second) || (fields >> rest))
+            continue;
+
+        // anything that isn't an address and a name is some other part of the listing
+        std::uint16_t address;
+        if (parse_address(first, address) && !std::isdigit(static_cast<unsigned char>(second[0])))
+            symbols[address] = second;
+        else if (parse_address(second, address) && !std::isdigit(static_cast<unsigned char>(first[0])))
+            symbols[address] = first;
+    }
+    return true;
+}
+
+std::string profiler::symbol_for(std::uint16_t address) const
+{
+    std::ostringstream name;
+    std::map<std::uint16_t, std::string>::const_iterator symbol = symbols.upper_bound(address);
+    if (symbol != symbols.begin()) {
+        --symbol;
+        name << symbol->second;
+        if (symbol->first != address)
+            name << "+0x" << std::hex << address - symbol->first;
+    } else {
+        name << "0x" << std::hex << std::setw(4) << std::setfill('0') << address;
+    }
+    return name.str();
+}
+
+std::string profiler::frame_name(std::uint32_t key) const
+{
+    if (key >= interrupt_frame)
+        return "interrupt " + symbol_for(key - interrupt_frame);
+    return symbol_for(key);
+}
+
+bool profiler::write(const std::string& filename) const
+{
+    std::ofstream out(filename, std::ios::out | std::ios::trunc);
+    if (!out.is_open()) {
+        std::cerr << "Error: could not open file \"" << filename << "\"" << std::endl;
+        return false;
+    }
+
+    std::uint64_t total_instructions = 0, total_cycles = 0;
+    std::vector<std::uint16_t> hot;
+    for (std::size_t address = 0; address < addresses.size(); address++) {
+        if (addresses[address].instructions == 0)
+            continue;
+        total_instructions += addresses[address].instructions;
+        total_cycles += addresses[address].cycles;
+        hot.push_back(static_cast<std::uint16_t>(address));
+    }
+    std::stable_sort(hot.begin(), hot.end(), [this](std::uint16_t a, std::uint16_t b) {
+        return addresses[a].cycles > addresses[b].cycles;
+    });
+
+    out << std::fixed << std::setprecision(2);
+    out << "Flat profile: " << total_instructions << " instructions, " << total_cycles << " cycles" << std::endl << std::endl;
+    out << "  % cycles       cycles instructions  address  symbol" << std::endl;
+    for (std::size_t i = 0; i < hot.size(); i++) {
+        const counts& c = addresses[hot[i]];
+        out << std::setw(10) << 100.0 * c.cycles / total_cycles << " " << std::setw(12) << c.cycles << " " << std::setw(12) << c.instructions
+            << "   0x" << std::hex << std::setw(4) << std::setfill('0') << hot[i] << std::dec << std::setfill(' ') << "  " << symbol_for(hot[i]) << std::endl;
+    }
+
+    out << std::endl << "By opcode:" << std::endl << std::endl;
+    out << "  % cycles       cycles instructions  opcode" << std::endl;
+    for (int i = 0; i < 0x40; i++) {
+        if (opcodes[i].instructions == 0)
+            continue;
+        const char* name = i < 0x20 ? basic_names[i] : special_names[i - 0x20];
+        out << std::setw(10) << 100.0 * opcodes[i].cycles / total_cycles << " " << std::setw(12) << opcodes[i].cycles << " "
+            << std::setw(12) << opcodes[i].instructions << "  " << (name ? name : "?") << std::endl;
+    }
+
+    out << std::endl << "HWI handling by device:" << std::endl << std::endl;
+    out << "   interrupts   host time (us)  device" << std::endl;
+    for (std::size_t i = 0; i < devices.size(); i++) {
+        out << std::setw(13) << devices[i].interrupts << " " << std::setw(16)
+            << std::chrono::duration<double, std::micro>(devices[i].time).count() << "  " << device_names[i] << std::endl;
+    }
+
+    if (!out) {
+        std::cerr << "Error: could not write profile \"" << filename << "\"" << std::endl;
+        return false;
+    }
+
+    // collapsed stacks: each frame's own cycles, under the names of the
+    // frames that led to it, separated by semicolons
+    std::string folded_filename = filename + ".folded";
+    std::ofstream folded(folded_filename, std::ios::out | std::ios::trunc);
+    if (!folded.is_open()) {
+        std::cerr << "Error: could not open file \"" << folded_filename << "\"" << std::endl;
+        return false;
+    }
+    for (std::size_t i = 0; i < frames.size(); i++) {
+        if (frames[i].cycles == 0)
+            continue;
+        std::string stack = frame_name(frames[i].key);
+        for (std::size_t f = i; f != 0; ) {
+            f = frames[f].parent;
+            stack = frame_name(frames[f].key) + ";" + stack;
+        }
+        folded << stack << " " << frames[i].cycles << "\n";
+    }
+    if (!folded) {
+        std::cerr << "Error: could not write profile \"" << folded_filename << "\"" << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,136 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include "machine.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+/// counts where emulated time goes: instructions and cycles per address and
+/// per opcode, a call tree built from JSRs, returns and interrupts, and the
+/// host time each device spends handling HWIs. cycles are the spec's costs
+/// for each instruction, since libsaturn doesn't say what it charged.
+///
+/// the profiler runs cycles itself (see run_cycles below), so a machine that
+/// isn't being profiled doesn't pay anything for it
+class profiler {
+    public:
+        profiler(const machine& m);
+
+        /// runs one cycle of the machine, counting it
+        void cycle(machine& m);
+
+        /// reads a symbol map: one symbol per line, as an address and a name
+        /// in either order ("0x0010 loop", "loop: 0x0010" or "loop = 16"), as
+        /// found in an assembler listing. returns false (having printed why)
+        /// if the file couldn't be read
+        bool load_symbols(const std::string& filename);
+
+        /// writes the flat profile to filename, and the call tree to
+        /// filename.folded as collapsed stacks for flamegraph.pl. both print
+        /// what went wrong and return false on failure
+        bool write(const std::string& filename) const;
+    private:
+        struct counts {
+            std::uint64_t instructions;
+            std::uint64_t cycles;
+        };
+
+        struct device_time {
+            std::uint64_t interrupts;
+            std::chrono::steady_clock::duration time;
+        };
+
+        /// a function in the call tree, reached through its parents; keys are
+        /// the function's address, or interrupt_frame plus IA for a handler
+        struct frame {
+            std::uint32_t key;
+            std::size_t parent;
+            std::uint64_t cycles;
+            std::map<std::uint32_t, std::size_t> children;
+        };
+
+        static const std::uint32_t interrupt_frame = 0x10000;
+        static const std::size_t max_depth = 256;
+
+        void enter(std::uint32_t key);
+        void leave(bool interrupt);
+        std::string symbol_for(std::uint16_t address) const;
+        std::string frame_name(std::uint32_t key) const;
+
+        std::vector<counts> addresses;
+        /// basic opcodes, then special opcodes from 0x20
+        counts opcodes[0x40];
+
+        std::vector<std::string> device_names;
+        std::vector<device_time> devices;
+
+        std::vector<frame> frames;
+        std::size_t current;
+        std::size_t depth;
+        /// frames entered past max_depth, which aren't in the tree, and how
+        /// many of them there were below each interrupt among them
+        std::size_t ignored;
+        std::vector<std::size_t> ignored_interrupts;
+
+        std::map<std::uint16_t, std::string> symbols;
+};
+
+/// runs cycles of m until count reaches end, through the profiler if there is
+/// one. returns early with the reason if the run has to end (see is_final; PC
+/// is left on an invalid opcode), idle if the program was idling when it got
+/// to end (which it never is under the profiler, which runs every cycle), and
+/// budget otherwise. under the profiler, watchpoints aren't seen
+inline stop_reason run_cycles(machine& m, profiler* profile, std::uint64_t& count, std::uint64_t end)
+{
+    if (profile) {
+        try {
+            for (; count < end; count++) {
+                stop_reason stop = m.stop_before();
+                if (stop != stop_reason::budget)
+                    return stop;
+                profile->cycle(m);
+            }
+        } catch(galaxy::saturn::invalid_opcode& e) {
+            return stop_reason::invalid_opcode;
+        }
+        return stop_reason::budget;
+    }
+
+    stop_reason reason = stop_reason::budget;
+    while (count < end) {
+        run_result result = m.run(end - count);
+        count += result.cycles;
+        reason = result.reason;
+        if (is_final(reason))
+            return reason;
+    }
+    return reason == stop_reason::idle ? reason : stop_reason::budget;
+}
+
+#endif
@@ -0,0 +1,307 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#include "snapshot.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+namespace {
+    const char magic[8] = { 'S', 'A', 'T', 'S', 'N', 'A', 'P', 0 };
+
+    // everything is stored little-endian, a byte at a time
+    void put16(std::ostream& out, std::uint16_t value)
+    {
+        out.put(value & 0xff);
+        out.put(value >> 8);
+    }
+
+    void put32(std::ostream& out, std::uint32_t value)
+    {
+        put16(out, value & 0xffff);
+        put16(out, value >> 16);
+    }
+
+    void put64(std::ostream& out, std::uint64_t value)
+    {
+        put32(out, value & 0xffffffff);
+        put32(out, value >> 32);
+    }
+
+    std::uint16_t get16(std::istream& in)
+    {
+        std::uint16_t low = in.get() & 0xff;
+        std::uint16_t high = in.get() & 0xff;
+        return low | (high << 8);
+    }
+
+    std::uint32_t get32(std::istream& in)
+    {
+        std::uint32_t low = get16(in);
+        return low | (static_cast<std::uint32_t>(get16(in)) << 16);
+    }
+
+    std::uint64_t get64(std::istream& in)
+    {
+        std::uint64_t low = get32(in);
+        return low | (static_cast<std::uint64_t>(get32(in)) << 32);
+    }
+
+    // memory is mostly zeroes, so it is stored as blocks, each starting with a
+    // header word: with the top bit set, the rest is a count of zero words;
+    // otherwise it is a count of literal words that follow
+    const std::uint16_t zero_run = 0x8000;
+    const std::uint16_t max_block = 0x7fff;
+
+    void put_ram(std::ostream& out, const std::vector<std::uint16_t>& ram)
+    {
+        std::size_t i = 0;
+        while (i < ram.size()) {
+            std::size_t end = i;
+            if (ram[i] == 0) {
+                while (end < ram.size() && ram[end] == 0 && end - i < max_block)
+                    end++;
+                put16(out, zero_run | (end - i));
+            } else {
+                // a lone zero isn't worth breaking a literal block for
+                while (end < ram.size() && end - i < max_block && (ram[end] != 0 || (end + 1 < ram.size() && ram[end + 1] != 0)))
+                    end++;
+                put16(out, end - i);
+                for (std::size_t j = i; j < end; j++)
+                    put16(out, ram[j]);
+            }
+            i = end;
+        }
+    }
+
+    bool get_ram(std::istream& in, std::vector<std::uint16_t>& ram)
+    {
+        std::size_t i = 0;
+        while (i < ram.size() && in) {
+            std::uint16_t header = get16(in);
+            std::size_t count = header & max_block;
+            if (count == 0 || i + count > ram.size())
+                return false;
+
+            for (std::size_t end = i + count; i < end; i++)
+                ram[i] = (header & zero_run) ? 0 : get16(in);
+        }
+        return static_cast<bool>(in);
+    }
+}
+
+bool snapshot::capture(const machine& m)
+{
+    // neither can be saved, since libsaturn doesn't let them be seen or set
+    if (!m.interrupts_settled()) {
+        std::cerr << "Error: can't take a snapshot while interrupts are enabled or may be queued" << std::endl;
+        return false;
+    }
+    for (std::size_t i = 0; i < m.drives.size(); i++) {
+        if (m.drive_busy(i)) {
+            std::cerr << "Error: can't take a snapshot while floppy drive " << i << " may be reading or writing" << std::endl;
+            return false;
+        }
+    }
+
+    num_lems = m.lems.size();
+    num_speds = m.speds.size();
+    disk_filenames = m.disk_filenames;
+
+    const galaxy::saturn::dcpu& cpu = m.cpu;
+    for (std::uint8_t i = 0; i < 8; i++)
+        registers[i] = register_at(cpu, i);
+    registers[8] = cpu.PC;
+    registers[9] = cpu.SP;
+    registers[10] = cpu.EX;
+    registers[11] = cpu.IA;
+
+    cycles = m.cycles;
+    ram.assign(cpu.ram.begin(), cpu.ram.end());
+
+    lems = m.lem_mappings;
+    speds = m.sped_mappings;
+    clock_interval = m.clock_interval;
+    clock_message = m.clock_message;
+    keyboard_message = m.keyboard_message;
+    drive_messages = m.drive_messages;
+    return true;
+}
+
+void snapshot::restore(machine& m) const
+{
+    galaxy::saturn::dcpu& cpu = m.cpu;
+    std::copy(ram.begin(), ram.end(), cpu.ram.begin());
+
+    // put the devices back the way the program left them, with the same
+    // HWIs it used to set them up
+    for (std::size_t i = 0; i < m.lems.size() && i < lems.size(); i++) {
+        m.send_hwi(m.lems[i], 0, lems[i].screen, 0, 0);
+        m.send_hwi(m.lems[i], 1, lems[i].font, 0, 0);
+        m.send_hwi(m.lems[i], 2, lems[i].palette, 0, 0);
+        m.send_hwi(m.lems[i], 3, lems[i].border, 0, 0);
+        m.lem_mappings[i] = lems[i];
+    }
+
+    for (std::size_t i = 0; i < m.speds.size() && i < speds.size(); i++) {
+        m.send_hwi(m.speds[i], 1, 0, speds[i].address, speds[i].count);
+        m.send_hwi(m.speds[i], 2, 0, speds[i].rotation, 0);
+        m.sped_mappings[i] = speds[i];
+    }
+
+    m.send_hwi(m.clock, 0, clock_interval, 0, 0);
+    m.send_hwi(m.clock, 2, clock_message, 0, 0);
+    m.clock_interval = clock_interval;
+    m.clock_message = clock_message;
+
+    m.send_hwi(m.keyboard, 3, keyboard_message, 0, 0);
+    m.keyboard_message = keyboard_message;
+
+    for (std::size_t i = 0; i < m.drives.size() && i < drive_messages.size(); i++) {
+        m.send_hwi(m.drives[i], 1, 0, drive_messages[i], 0);
+        m.drive_messages[i] = drive_messages[i];
+    }
+
+    // registers last, since the HWIs above borrow them
+    for (std::uint8_t i = 0; i < 8; i++)
+        register_at(cpu, i) = registers[i];
+    cpu.PC = registers[8];
+    cpu.SP = registers[9];
+    cpu.EX = registers[10];
+    cpu.IA = registers[11];
+
+    m.cycles = cycles;
+}
+
+bool snapshot::save(const std::string& filename) const
+{
+    std::ofstream out(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        std::cerr << "Error: could not open file \"" << filename << "\"" << std::endl;
+        return false;
+    }
+
+    out.write(magic, sizeof(magic));
+    put32(out, version);
+
+    put16(out, num_lems);
+    put16(out, num_speds);
+    put16(out, disk_filenames.size());
+    for (auto it = disk_filenames.begin(); it != disk_filenames.end(); ++it) {
+        put16(out, it->size());
+        out.write(it->data(), it->size());
+    }
+
+    for (int i = 0; i < 12; i++)
+        put16(out, registers[i]);
+    put64(out, cycles);
+    put_ram(out, ram);
+
+    for (auto it = lems.begin(); it != lems.end(); ++it) {
+        put16(out, it->screen);
+        put16(out, it->font);
+        put16(out, it->palette);
+        put16(out, it->border);
+    }
+    for (auto it = speds.begin(); it != speds.end(); ++it) {
+        put16(out, it->address);
+        put16(out, it->count);
+        put16(out, it->rotation);
+    }
+    put16(out, clock_interval);
+    put16(out, clock_message);
+    put16(out, keyboard_message);
+    for (auto it = drive_messages.begin(); it != drive_messages.end(); ++it)
+        put16(out, *it);
+
+    if (!out) {
+        std::cerr << "Error: could not write snapshot \"" << filename << "\"" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool snapshot::load(const std::string& filename)
+{
+    std::ifstream in(filename, std::ios::in | std::ios::binary);
+    if (!in.is_open()) {
+        std::cerr << "Error: could not open file \"" << filename << "\"" << std::endl;
+        return false;
+    }
+
+    char header[sizeof(magic)];
+    in.read(header, sizeof(header));
+    if (!in || !std::equal(header, header + sizeof(header), magic)) {
+        std::cerr << "Error: \"" << filename << "\" is not a saturn snapshot" << std::endl;
+        return false;
+    }
+
+    std::uint32_t file_version = get32(in);
+    if (file_version != version) {
+        std::cerr << "Error: snapshot \"" << filename << "\" is version " << file_version << ", expected " << version << std::endl;
+        return false;
+    }
+
+    num_lems = get16(in);
+    num_speds = get16(in);
+    std::uint16_t num_drives = get16(in);
+    disk_filenames.clear();
+    for (std::uint16_t i = 0; i < num_drives && in; i++) {
+        std::string name(get16(in), '\0');
+        in.read(&name[0], name.size());
+        disk_filenames.push_back(name);
+    }
+
+    for (int i = 0; i < 12; i++)
+        registers[i] = get16(in);
+    cycles = get64(in);
+
+    ram.assign(0x10000, 0);
+    bool ram_ok = get_ram(in, ram);
+
+    lems.resize(num_lems);
+    for (auto it = lems.begin(); it != lems.end(); ++it) {
+        it->screen = get16(in);
+        it->font = get16(in);
+        it->palette = get16(in);
+        it->border = get16(in);
+    }
+    speds.resize(num_speds);
+    for (auto it = speds.begin(); it != speds.end(); ++it) {
+        it->address = get16(in);
+        it->count = get16(in);
+        it->rotation = get16(in);
+    }
+    clock_interval = get16(in);
+    clock_message = get16(in);
+    keyboard_message = get16(in);
+    drive_messages.resize(num_drives);
+    for (auto it = drive_messages.begin(); it != drive_messages.end(); ++it)
+        *it = get16(in);
+
+    if (!ram_ok || !in) {
+        std::cerr << "Error: snapshot \"" << filename << "\" is truncated or corrupt" << std::endl;
+        return false;
+    }
+    return true;
+}
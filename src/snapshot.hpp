@@ -0,0 +1,77 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include "machine.hpp"
+
+#include <cstdint>
+#include <list>
+#include <string>
+#include <vector>
+
+/// a saved machine: the device layout it was built with, the cpu's registers,
+/// memory and cycle count, and the device configuration the machine tracked
+/// from the program's HWIs (so the machine must have been watching them).
+///
+/// libsaturn keeps some state to itself, which doesn't survive a snapshot:
+/// the interrupt queue and whether it's queueing, the clock's phase within a
+/// tick, the keyboard buffer and any floppy operation in flight. so a snapshot
+/// is refused while interrupts are enabled or may be queued, or while a drive
+/// may be busy (see machine::interrupts_settled and machine::drive_busy); the
+/// clock's phase and the keyboard buffer are still lost. disk contents live in
+/// the image files, so a snapshot can't be taken of disks whose writes are
+/// kept elsewhere (the plain overlay backend)
+struct snapshot {
+    static const std::uint32_t version = 1;
+
+    /// fills the snapshot in from a machine; prints what went wrong and
+    /// returns false if it has state the snapshot couldn't hold
+    bool capture(const machine& m);
+
+    /// puts a machine built from num_lems, num_speds and disk_filenames into
+    /// the saved state, reconfiguring its devices with the HWIs they were sent
+    void restore(machine& m) const;
+
+    /// both print what went wrong and return false on failure
+    bool save(const std::string& filename) const;
+    bool load(const std::string& filename);
+
+    std::uint16_t num_lems;
+    std::uint16_t num_speds;
+    std::list<std::string> disk_filenames;
+
+    /// A, B, C, X, Y, Z, I, J, PC, SP, EX, IA
+    std::uint16_t registers[12];
+    std::uint64_t cycles;
+    std::vector<std::uint16_t> ram;
+
+    std::vector<lem_mapping> lems;
+    std::vector<sped_mapping> speds;
+    std::uint16_t clock_interval;
+    std::uint16_t clock_message;
+    std::uint16_t keyboard_message;
+    std::vector<std::uint16_t> drive_messages;
+};
+
+#endif
@@ -0,0 +1,39 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#include "sped_frame.hpp"
+
+#include <algorithm>
+
+void sped_frame::capture(const galaxy::saturn::dcpu& cpu, const sped_mapping& mapping)
+{
+    count = std::min<std::uint16_t>(mapping.count, max_vertices);
+    rotation = mapping.rotation;
+
+    for (unsigned int i = 0; i < count * 2u; i++)
+        words[i] = cpu.ram[static_cast<std::uint16_t>(mapping.address + i)];
+}
+
+bool sped_frame::compare(const sped_frame& other) const
+{
+    return count != other.count || rotation != other.rotation || !std::equal(words.begin(), words.begin() + count * 2, other.words.begin());
+}
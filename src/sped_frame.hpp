@@ -0,0 +1,51 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#ifndef SPED_FRAME_HPP
+#define SPED_FRAME_HPP
+
+#include <libsaturn.hpp>
+
+#include "machine.hpp"
+
+#include <array>
+#include <cstdint>
+
+/// everything a SPED-3 window needs to project the hologram, captured on the
+/// emulation thread from wherever the program mapped its vertices
+struct sped_frame {
+    static const unsigned int max_vertices = 128;
+
+    void capture(const galaxy::saturn::dcpu& cpu, const sped_mapping& mapping);
+
+    /// whether anything differs from other
+    bool compare(const sped_frame& other) const;
+
+    /// two words per vertex: x in the low byte and y in the high byte of the
+    /// first; z in the low byte, colour in bits 8-9 and intensity in bit 10
+    /// of the second. only the first count vertices are meaningful
+    std::array<std::uint16_t, max_vertices * 2> words;
+    std::uint16_t count;
+    std::uint16_t rotation;
+};
+
+#endif
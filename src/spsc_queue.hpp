@@ -0,0 +1,79 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+
+/// lock-free bounded single producer, single consumer queue. the producer
+/// pushes, the consumer peeks and pops; neither ever waits for the other, and
+/// a push onto a full queue fails rather than blocking. capacity must be a
+/// power of two
+template <typename T, std::size_t capacity>
+class spsc_queue {
+    public:
+        spsc_queue() : items(), head(0), tail(0) {}
+
+        /// producer side: returns false if the queue was full
+        bool push(const T& item)
+        {
+            std::size_t t = tail.load(std::memory_order_relaxed);
+            if (t - head.load(std::memory_order_acquire) == capacity)
+                return false;
+
+            items[t & mask] = item;
+            tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        /// consumer side: the oldest item, or null if the queue is empty. it
+        /// stays valid until pop()
+        const T* front() const
+        {
+            std::size_t h = head.load(std::memory_order_relaxed);
+            if (h == tail.load(std::memory_order_acquire))
+                return 0;
+            return &items[h & mask];
+        }
+
+        /// consumer side: drops the oldest item, which front() must have found
+        void pop()
+        {
+            head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+    private:
+        static const std::size_t mask = capacity - 1;
+        static_assert((capacity & mask) == 0, "spsc_queue capacity must be a power of two");
+
+        T items[capacity];
+
+        // both only ever grow; the slot is the count modulo capacity
+        std::atomic<std::size_t> head;
+        std::atomic<std::size_t> tail;
+
+        spsc_queue(const spsc_queue&);
+        spsc_queue& operator=(const spsc_queue&);
+};
+
+#endif
@@ -0,0 +1,62 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#include "stop_points.hpp"
+
+void stop_points::set_breakpoint(std::uint16_t address, bool set)
+{
+    if (breakpoints[address] == set)
+        return;
+    breakpoints[address] = set;
+    if (set)
+        breaks++;
+    else
+        breaks--;
+}
+
+void stop_points::set_watched(std::uint16_t address, bool set)
+{
+    if (watched[address] == set)
+        return;
+    watched[address] = set;
+    if (set)
+        watches++;
+    else
+        watches--;
+}
+
+bool stop_points::might_stop(const instruction& ins) const
+{
+    if (breakpoints[ins.address])
+        return true;
+    if (watches == 0)
+        return false;
+
+    // only a write to a fixed address can be ruled out before it happens
+    if (ins.is_special() && ins.special == instruction::JSR)
+        return true;
+    std::uint8_t operand;
+    std::uint16_t next;
+    if (!ins.written_operand(operand, next) || !instruction::is_memory(operand))
+        return false;
+    return operand != instruction::NEXT_WORD_ADDRESS || watched[next];
+}
@@ -0,0 +1,59 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#ifndef STOP_POINTS_HPP
+#define STOP_POINTS_HPP
+
+#include "dcpu_decode.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// where machine::run stops on the program's account: before the instruction
+/// at a breakpoint, and after an instruction that writes to a watched word of
+/// memory. saturn's cores leave any instruction that might do either to the
+/// machine, which checks it as it runs it; writes made by devices and by
+/// interrupts being delivered aren't seen
+class stop_points {
+    public:
+        stop_points() : breakpoints(0x10000), watched(0x10000), breaks(0), watches(0) {}
+
+        bool is_breakpoint(std::uint16_t address) const { return breakpoints[address]; }
+        bool is_watched(std::uint16_t address) const { return watched[address]; }
+        bool watching() const { return watches != 0; }
+        bool empty() const { return breaks == 0 && watches == 0; }
+
+        void set_breakpoint(std::uint16_t address, bool set);
+        void set_watched(std::uint16_t address, bool set);
+
+        /// whether the instruction, at its own address, is at a breakpoint or
+        /// could write to a watched word, going by its operands alone
+        bool might_stop(const instruction& ins) const;
+    private:
+        std::vector<bool> breakpoints;
+        std::vector<bool> watched;
+        std::size_t breaks;
+        std::size_t watches;
+};
+
+#endif
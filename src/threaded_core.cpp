@@ -0,0 +1,320 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#include "threaded_core.hpp"
+#include "dcpu_alu.hpp"
+
+threaded_core::threaded_core(galaxy::saturn::dcpu& cpu, device_schedule& schedule, const stop_points& stops) : cpu(cpu), schedule(schedule),
+    stops(stops), cache(0x10000), stages(0), ops(0)
+{
+    registers[0] = &cpu.A;
+    registers[1] = &cpu.B;
+    registers[2] = &cpu.C;
+    registers[3] = &cpu.X;
+    registers[4] = &cpu.Y;
+    registers[5] = &cpu.Z;
+    registers[6] = &cpu.I;
+    registers[7] = &cpu.J;
+
+    forget_all();
+
+    std::uint64_t done = 0;
+    interpret(0, done, true);
+}
+
+void threaded_core::step()
+{
+    // libsaturn delivers queued interrupts at the start of a cycle, and only
+    // it can see whether there are any. the interpreter won't start on an
+    // instruction run() has to stop at, so libsaturn gets those too
+    const entry& e = fetch(cpu.PC);
+    if (cpu.IA != 0 || !e.stage || e.stops || (e.spins && stop_at_spins)) {
+        cpu.cycle();
+        return;
+    }
+
+    std::uint64_t done = 0;
+    interpret(1, done, false);
+}
+
+void threaded_core::run(std::uint64_t budget, std::uint64_t& done)
+{
+    interpret(budget, done, false);
+}
+
+void threaded_core::forget(std::uint16_t address)
+{
+    cache[address].length = 0;
+}
+
+void threaded_core::forget_all()
+{
+    for (std::size_t i = 0; i < cache.size(); i++)
+        cache[i].length = 0;
+}
+
+inline threaded_core::entry& threaded_core::fetch(std::uint16_t address)
+{
+    entry& e = cache[address];
+
+    // an entry is only good while the words it was decoded from are still there
+    const std::array<std::uint16_t, 0x10000>& ram = cpu.ram;
+    bool valid = e.length != 0 && ram[address] == e.words[0]
+        && (e.length < 2 || ram[static_cast<std::uint16_t>(address + 1)] == e.words[1])
+        && (e.length < 3 || ram[static_cast<std::uint16_t>(address + 2)] == e.words[2]);
+
+    if (!valid)
+        decode_into(e, address);
+    return e;
+}
+
+template <int kind, bool is_a>
+inline std::uint16_t* threaded_core::resolve(const operand& o, std::uint16_t& scratch)
+{
+    // kind is known at compile time, so all but one case folds away
+    switch (kind) {
+        case fixed:
+            return o.base;
+        case indirect:
+            return &cpu.ram[static_cast<std::uint16_t>(*o.base + o.value)];
+        case stack:
+            return is_a ? &cpu.ram[cpu.SP++] : &cpu.ram[--cpu.SP];
+    }
+
+    scratch = o.value;
+    return &scratch;
+}
+
+void threaded_core::interpret(std::uint64_t budget, std::uint64_t& done, bool init)
+{
+#define STAGE_ROW(a_kind) &&stage_##a_kind##_fixed, &&stage_##a_kind##_indirect, &&stage_##a_kind##_stack, &&stage_##a_kind##_literal
+    static const void* const stage_labels[operand_kinds * operand_kinds + operand_kinds] = {
+        STAGE_ROW(fixed), STAGE_ROW(indirect), STAGE_ROW(stack), STAGE_ROW(literal),
+        &&special_fixed, &&special_indirect, &&special_stack, &&special_literal
+    };
+#undef STAGE_ROW
+
+    static const void* const op_labels[0x40] = {
+        0, &&op_SET, &&op_ADD, &&op_SUB, &&op_MUL, &&op_MLI, &&op_DIV, &&op_DVI,
+        &&op_MOD, &&op_MDI, &&op_AND, &&op_BOR, &&op_XOR, &&op_SHR, &&op_ASR, &&op_SHL,
+        &&op_IFB, &&op_IFC, &&op_IFE, &&op_IFN, &&op_IFG, &&op_IFA, &&op_IFL, &&op_IFU,
+        0, 0, &&op_ADX, &&op_SBX, 0, 0, &&op_STI, &&op_STD,
+        0, &&op_JSR, 0, 0, 0, 0, 0, 0,
+        0, &&op_IAG, &&op_IAS, 0, 0, 0, 0, 0
+    };
+
+    if (init) {
+        stages = stage_labels;
+        ops = op_labels;
+        return;
+    }
+
+    entry* e;
+    std::uint16_t address;
+    std::uint16_t a = 0;
+    std::uint16_t* b = 0;
+    std::uint16_t* target = 0;
+    std::uint16_t scratch_a;
+    std::uint16_t scratch_b;
+
+next:
+    if (done >= budget || cpu.IA != 0)
+        return;
+    e = &fetch(cpu.PC);
+    if (!e->stage || e->stops || (e->spins && stop_at_spins))
+        return;
+
+    schedule.tick();
+
+    // a device may have just written over the instruction, as in dcpu_core
+    e = &fetch(cpu.PC);
+    if (!e->stage) {
+        cpu.cycle();
+        done++;
+        return;
+    }
+    address = cpu.PC;
+    goto *e->stage;
+
+    // PC moves past each word as it's read, which shows if an operand is PC
+#define STAGE(a_kind, b_kind) \
+    stage_##a_kind##_##b_kind: \
+        cpu.PC = address + e->a_length; \
+        a = *resolve<a_kind, true>(e->a, scratch_a); \
+        cpu.PC = address + e->length; \
+        b = resolve<b_kind, false>(e->b, scratch_b); \
+        goto *e->op;
+
+    STAGE(fixed, fixed) STAGE(fixed, indirect) STAGE(fixed, stack) STAGE(fixed, literal)
+    STAGE(indirect, fixed) STAGE(indirect, indirect) STAGE(indirect, stack) STAGE(indirect, literal)
+    STAGE(stack, fixed) STAGE(stack, indirect) STAGE(stack, stack) STAGE(stack, literal)
+    STAGE(literal, fixed) STAGE(literal, indirect) STAGE(literal, stack) STAGE(literal, literal)
+#undef STAGE
+
+#define SPECIAL(a_kind) \
+    special_##a_kind: \
+        cpu.PC = address + e->length; \
+        target = resolve<a_kind, true>(e->a, scratch_a); \
+        goto *e->op;
+
+    SPECIAL(fixed) SPECIAL(indirect) SPECIAL(stack) SPECIAL(literal)
+#undef SPECIAL
+
+#define BASIC(name) \
+    op_##name: \
+        if (!alu<instruction::name>(*b, a, cpu.EX)) \
+            skip(); \
+        done++; \
+        goto next;
+
+    BASIC(SET) BASIC(ADD) BASIC(SUB) BASIC(MUL) BASIC(MLI) BASIC(DIV) BASIC(DVI)
+    BASIC(MOD) BASIC(MDI) BASIC(AND) BASIC(BOR) BASIC(XOR) BASIC(SHR) BASIC(ASR) BASIC(SHL)
+    BASIC(IFB) BASIC(IFC) BASIC(IFE) BASIC(IFN) BASIC(IFG) BASIC(IFA) BASIC(IFL) BASIC(IFU)
+    BASIC(ADX) BASIC(SBX)
+#undef BASIC
+
+op_STI:
+    alu<instruction::STI>(*b, a, cpu.EX);
+    cpu.I++;
+    cpu.J++;
+    done++;
+    goto next;
+
+op_STD:
+    alu<instruction::STD>(*b, a, cpu.EX);
+    cpu.I--;
+    cpu.J--;
+    done++;
+    goto next;
+
+op_JSR:
+    a = *target;
+    cpu.ram[--cpu.SP] = cpu.PC;
+    cpu.PC = a;
+    done++;
+    goto next;
+
+op_IAG:
+    *target = cpu.IA;
+    done++;
+    goto next;
+
+op_IAS:
+    cpu.IA = *target;
+    done++;
+    goto next;
+}
+
+void threaded_core::decode_into(entry& e, std::uint16_t address)
+{
+    instruction ins = decode(cpu.ram, address);
+    for (std::uint8_t i = 0; i < ins.length; i++)
+        e.words[i] = cpu.ram[static_cast<std::uint16_t>(address + i)];
+    e.length = ins.length;
+    e.a_length = 1 + instruction::has_next_word(ins.a);
+    e.spins = ins.is_self_jump();
+    e.stops = stops.might_stop(ins);
+    e.stage = 0;
+    e.op = 0;
+
+    if (!ins.is_valid())
+        return;
+
+    e.a = describe(ins.a, ins.next_a);
+    if (ins.is_special()) {
+        if (ins.special == instruction::JSR || ins.special == instruction::IAG || ins.special == instruction::IAS) {
+            e.stage = stages[operand_kinds * operand_kinds + e.a.kind];
+            e.op = ops[0x20 + ins.special];
+        }
+        return;
+    }
+
+    e.b = describe(ins.b, ins.next_b);
+    e.stage = stages[e.a.kind * operand_kinds + e.b.kind];
+    e.op = ops[ins.opcode];
+}
+
+threaded_core::operand threaded_core::describe(std::uint8_t code, std::uint16_t next)
+{
+    operand o;
+    o.base = 0;
+    o.value = 0;
+    o.kind = fixed;
+
+    if (code < 0x08) {
+        o.base = registers[code];
+    } else if (code < 0x18) {
+        o.kind = indirect;
+        o.base = registers[code & 0x07];
+        if (code >= 0x10)
+            o.value = next;
+    } else {
+        switch (code) {
+            case instruction::PUSH_POP:
+                o.kind = stack;
+                break;
+            case instruction::PEEK:
+                o.kind = indirect;
+                o.base = &cpu.SP;
+                break;
+            case instruction::PICK:
+                o.kind = indirect;
+                o.base = &cpu.SP;
+                o.value = next;
+                break;
+            case instruction::SP:
+                o.base = &cpu.SP;
+                break;
+            case instruction::PC:
+                o.base = &cpu.PC;
+                break;
+            case instruction::EX:
+                o.base = &cpu.EX;
+                break;
+            case instruction::NEXT_WORD_ADDRESS:
+                o.base = &cpu.ram[next];
+                break;
+            case instruction::NEXT_WORD:
+                o.kind = literal;
+                o.value = next;
+                break;
+            default:
+                // short literals, -1 to 30
+                o.kind = literal;
+                o.value = static_cast<std::uint16_t>(code - instruction::SHORT_LITERAL - 1);
+                break;
+        }
+    }
+    return o;
+}
+
+void threaded_core::skip()
+{
+    // each skipped conditional takes the one after it along with it
+    bool conditional;
+    do {
+        const entry& next = fetch(cpu.PC);
+        std::uint8_t opcode = next.words[0] & 0x1f;
+        cpu.PC += next.length;
+        conditional = opcode >= instruction::IFB && opcode <= instruction::IFU;
+    } while (conditional);
+}
@@ -0,0 +1,117 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#ifndef THREADED_CORE_HPP
+#define THREADED_CORE_HPP
+
+#include <libsaturn.hpp>
+
+#include "cpu_core.hpp"
+#include "device_schedule.hpp"
+#include "stop_points.hpp"
+#include "dcpu_decode.hpp"
+
+#include <cstdint>
+#include <vector>
+
+/// saturn's direct-threaded interpreter, built when SATURN_THREADED_CORE is
+/// set since it needs GCC's labels as values (clang has them too). like
+/// dcpu_core it keeps a cache of decoded instructions, checked against the
+/// words they came from, and hands the same instructions to dcpu::cycle().
+///
+/// each entry holds the addresses of two labels in the interpreter loop: the
+/// stage that resolves its operands, one per pair of operand kinds and
+/// specialised for them by template, and the stage that runs its opcode.
+/// every instruction is two indirect jumps, with no switch on the opcode or
+/// the operand codes and no call through a handler
+class threaded_core : public cpu_core {
+    public:
+        /// the devices are ticked through schedule
+        threaded_core(galaxy::saturn::dcpu& cpu, device_schedule& schedule, const stop_points& stops);
+
+        void step();
+        void run(std::uint64_t budget, std::uint64_t& done);
+        void forget(std::uint16_t address);
+        void forget_all();
+    private:
+        /// where an operand is: at a fixed place (a register, SP, PC, EX or
+        /// the word at a literal address), at an offset from a register or SP,
+        /// on the stack, or a literal value, which can be written to but keeps
+        /// nothing
+        enum operand_kind { fixed, indirect, stack, literal, operand_kinds };
+
+        struct operand {
+            /// the word itself when fixed, the register or SP when indirect
+            std::uint16_t* base;
+            /// the offset when indirect, the value when a literal
+            std::uint16_t value;
+            std::uint8_t kind;
+        };
+
+        /// an instruction as decoded at some address; stage is null for
+        /// anything libsaturn has to run, and length is zero for an empty
+        /// entry. spins is set for an instruction that only jumps to itself,
+        /// and stops for one the stop points might stop at
+        struct entry {
+            const void* stage;
+            const void* op;
+            std::uint16_t words[3];
+            operand a;
+            operand b;
+            /// where PC is when a is evaluated, and after the whole instruction
+            std::uint8_t a_length;
+            std::uint8_t length;
+            bool spins;
+            bool stops;
+        };
+
+        /// the interpreter loop. called once with init set, when all it does
+        /// is hand out the addresses of its labels for decode_into()
+        void interpret(std::uint64_t budget, std::uint64_t& done, bool init);
+
+        entry& fetch(std::uint16_t address);
+        void decode_into(entry& e, std::uint16_t address);
+        operand describe(std::uint8_t code, std::uint16_t next);
+
+        template <int kind, bool is_a> std::uint16_t* resolve(const operand& o, std::uint16_t& scratch);
+
+        /// steps PC over the instruction at PC, and any conditionals chained
+        /// after it
+        void skip();
+
+        galaxy::saturn::dcpu& cpu;
+        device_schedule& schedule;
+        const stop_points& stops;
+        std::uint16_t* registers[8];
+        std::vector<entry> cache;
+
+        /// operand stages by a's kind and then b's, with special opcodes'
+        /// stages (for a alone) after them; opcode stages by basic opcode, then
+        /// by special opcode from 0x20
+        const void* const* stages;
+        const void* const* ops;
+
+        threaded_core(const threaded_core&);
+        threaded_core& operator=(const threaded_core&);
+};
+
+#endif
@@ -0,0 +1,75 @@
+/*
+
+This file is part of saturn.
+
+saturn is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+saturn is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with saturn.  If not, see <http://www.gnu.org/licenses/>.
+
+Your copy of the GNU General Public License should be in the
+file named "LICENSE.txt".
+
+*/
+
+#ifndef TRIPLE_BUFFER_HPP
+#define TRIPLE_BUFFER_HPP
+
+#include <atomic>
+
+/// lock-free single producer, single consumer triple buffer. the producer
+/// fills write_buffer() and publishes it, the consumer picks up whatever was
+/// published most recently; neither side ever waits for the other, and
+/// intermediate buffers the consumer was too slow to see are simply dropped
+template <typename T>
+class triple_buffer {
+    public:
+        triple_buffer() : buffers(), back(0), middle(1), front(2) {}
+
+        /// producer side: the buffer to fill in next
+        T& write_buffer() { return buffers[back]; }
+
+        /// producer side: hand the write buffer over to the consumer, and take
+        /// whichever buffer the consumer isn't looking at as the next one
+        void publish()
+        {
+            back = middle.exchange(back | fresh, std::memory_order_acq_rel) & index_mask;
+        }
+
+        /// consumer side: swap in the most recently published buffer, if there
+        /// is one; returns whether read_buffer() changed
+        bool update()
+        {
+            if (!(middle.load(std::memory_order_relaxed) & fresh))
+                return false;
+
+            front = middle.exchange(front, std::memory_order_acq_rel) & index_mask;
+            return true;
+        }
+
+        /// consumer side: the buffer most recently picked up by update()
+        const T& read_buffer() const { return buffers[front]; }
+    private:
+        // the middle index carries a flag saying it was published but not yet consumed
+        static const int index_mask = 0x3;
+        static const int fresh = 0x4;
+
+        T buffers[3];
+
+        int back;
+        std::atomic<int> middle;
+        int front;
+
+        triple_buffer(const triple_buffer&);
+        triple_buffer& operator=(const triple_buffer&);
+};
+
+#endif